@@ -0,0 +1,112 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace libstrings {
+
+    string_arena::string_arena() : _next(NULL), _reserved(NULL), _remaining(0), _size(0) {}
+
+    string_arena::~string_arena() {
+        clear();
+    }
+
+    const char * string_arena::store(const char * str, const size_t length) {
+        memcpy(reserve(length), str, length);
+        return commit(length);
+    }
+
+    char * string_arena::reserve(const size_t maxLength) {
+        const size_t needed = maxLength + 1;
+
+        if (needed <= _remaining)
+            _reserved = _next;
+        else {
+            _blocks.reserve(_blocks.size() + 1);  //So that pushing the new block can't throw.
+            if (needed > blockSize / 4) {
+                //Large strings get a block of their own, so that the current block can still be filled.
+                _reserved = new char[needed];
+                _blocks.push_back(_reserved);
+            } else {
+                _next = new char[blockSize];
+                _blocks.push_back(_next);
+                _remaining = blockSize;
+                _reserved = _next;
+            }
+        }
+
+        return _reserved;
+    }
+
+    const char * string_arena::commit(const size_t length) {
+        char * dest = _reserved;
+        dest[length] = '\0';
+        _size += length + 1;
+
+        //Strings in blocks of their own don't take up any of the current block.
+        if (dest == _next) {
+            _next += length + 1;
+            _remaining -= length + 1;
+        }
+
+        return dest;
+    }
+
+    size_t string_arena::size() const {
+        return _size;
+    }
+
+    void string_arena::splice(string_arena& other) {
+        _blocks.insert(_blocks.end(), other._blocks.begin(), other._blocks.end());
+        _size += other._size;
+
+        other._blocks.clear();
+        other._next = NULL;
+        other._reserved = NULL;
+        other._remaining = 0;
+        other._size = 0;
+    }
+
+    void string_arena::swap(string_arena& other) {
+        _blocks.swap(other._blocks);
+        std::swap(_next, other._next);
+        std::swap(_reserved, other._reserved);
+        std::swap(_remaining, other._remaining);
+        std::swap(_size, other._size);
+    }
+
+    void string_arena::clear() {
+        for (vector<char *>::iterator it=_blocks.begin(), endIt=_blocks.end(); it != endIt; ++it)
+            delete [] *it;
+        _blocks.clear();
+        _next = NULL;
+        _reserved = NULL;
+        _remaining = 0;
+        _size = 0;
+    }
+}
@@ -0,0 +1,69 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_ARENA_H__
+#define __LIBSTRINGS_ARENA_H__
+
+#include <stddef.h>
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+namespace libstrings {
+
+    /* Stores null-terminated strings back to back in large blocks, so that a
+       handle's strings don't each need their own allocation. Strings can't
+       be freed individually: stored strings stay valid until the arena is
+       cleared or destroyed, so replacing a string leaves its old copy as
+       dead space until the strings still in use are copied to a new arena. */
+    class string_arena : boost::noncopyable {
+    public:
+        string_arena();
+        ~string_arena();
+
+        //Copies the given string into the arena, returning the null-terminated copy.
+        const char * store(const char * str, const size_t length);
+
+        //Makes room for a string of up to the given length, returning where to write it. The string is only stored once commit() is given its actual length, which must not be greater, and it is null-terminated then.
+        char * reserve(const size_t maxLength);
+        const char * commit(const size_t length);
+
+        //The number of bytes stored, including null terminators.
+        size_t size() const;
+
+        //Takes ownership of all the strings in the other arena, leaving it empty.
+        void splice(string_arena& other);
+
+        void swap(string_arena& other);
+        void clear();
+    private:
+        static const size_t blockSize = 64 * 1024;
+
+        std::vector<char *> _blocks;
+        char * _next;
+        char * _reserved;
+        size_t _remaining;
+        size_t _size;
+    };
+}
+
+#endif
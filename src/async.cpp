@@ -0,0 +1,249 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "async.h"
+#include "error.h"
+#include "trace.h"
+#include <new>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace libstrings;
+
+namespace {
+    /* A fixed set of worker threads taking tasks from a queue. Threads are
+       started when the first task is submitted, and are stopped once the
+       tasks already queued have run when the pool is destroyed. */
+    class worker_pool : boost::noncopyable {
+    public:
+        worker_pool() : _stopping(false) {}
+
+        ~worker_pool() {
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                _stopping = true;
+            }
+            _taskAdded.notify_all();
+            _threads.join_all();
+        }
+
+        void submit(const boost::function<void ()>& task) {
+            boost::mutex::scoped_lock lock(_mutex);
+            if (_workers.empty()) {
+                //Opens and saves are mostly I/O, so even one core benefits from more than one worker.
+                const size_t count = max(2U, boost::thread::hardware_concurrency());
+                try {
+                    for (size_t i=0; i < count; i++)
+                        _workers.push_back(_threads.create_thread(boost::bind(&worker_pool::work, this))->get_id());
+                } catch (boost::thread_resource_error&) {
+                    //Make do with the threads that could be created.
+                    if (_workers.empty())
+                        throw;
+                }
+            }
+            _tasks.push_back(task);
+            _taskAdded.notify_one();
+        }
+
+        bool is_worker() {
+            boost::mutex::scoped_lock lock(_mutex);
+            return find(_workers.begin(), _workers.end(), boost::this_thread::get_id()) != _workers.end();
+        }
+    private:
+        void work() {
+            while (true) {
+                boost::function<void ()> task;
+                {
+                    boost::mutex::scoped_lock lock(_mutex);
+                    while (_tasks.empty() && !_stopping)
+                        _taskAdded.wait(lock);
+                    if (_tasks.empty())
+                        return;
+                    task = _tasks.front();
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+        boost::mutex _mutex;
+        boost::condition_variable _taskAdded;
+        deque< boost::function<void ()> > _tasks;
+        boost::thread_group _threads;
+        vector<boost::thread::id> _workers;
+        bool _stopping;
+    };
+
+    /* The pool is created when first needed and only destroyed by
+       StopAsync(), as joining threads from a static destructor can deadlock
+       when the library is unloaded. */
+    boost::mutex poolMutex;
+    worker_pool * pool = NULL;
+}
+
+namespace libstrings {
+    void RunAsync(const boost::function<void ()>& task) {
+        boost::mutex::scoped_lock lock(poolMutex);
+        if (pool == NULL)
+            pool = new worker_pool();
+        pool->submit(task);
+    }
+
+    void StopAsync() {
+        worker_pool * stopping;
+        {
+            boost::mutex::scoped_lock lock(poolMutex);
+            if (pool != NULL && pool->is_worker())
+                throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "The worker threads can't be stopped by one of themselves.");
+            stopping = pool;
+            pool = NULL;
+        }
+        //Operations submitted from now on start a new pool.
+        delete stopping;
+    }
+
+    void OpenTask(_strings_async_int * op, const string& path, const string& fallbackEncoding, const bool mapFile) {
+        LIBSTRINGS_TRACE("st_open_async");
+
+        if (op->cancel.is_set()) {
+            op->Finish(LIBSTRINGS_ERROR_CANCELLED, "The opening of \"" + path + "\" was cancelled.", NULL);
+            return;
+        }
+
+        _strings_handle_int * handle = NULL;
+        try {
+            handle = new _strings_handle_int(path, fallbackEncoding, mapFile);
+        } catch (bad_alloc& e) {
+            op->Finish(LIBSTRINGS_ERROR_NO_MEM, e.what(), NULL);
+            return;
+        } catch (error& e) {
+            op->Finish(e.code(), e.what(), NULL);
+            return;
+        } catch (exception& e) {
+            //Anything else, e.g. a filesystem_error, would otherwise terminate the program when it escaped the worker thread.
+            op->Finish(LIBSTRINGS_ERROR_FILE_READ_FAIL, e.what(), NULL);
+            return;
+        } catch (...) {
+            op->Finish(LIBSTRINGS_ERROR_FILE_READ_FAIL, "An unknown error occurred while opening \"" + path + "\".", NULL);
+            return;
+        }
+
+        //Opening can't be interrupted, so a cancellation while it ran discards the handle.
+        if (op->cancel.is_set()) {
+            delete handle;
+            op->Finish(LIBSTRINGS_ERROR_CANCELLED, "The opening of \"" + path + "\" was cancelled.", NULL);
+            return;
+        }
+
+        op->Finish(LIBSTRINGS_OK, "", handle);
+    }
+
+    void SaveTask(_strings_async_int * op, _strings_handle_int * snapshot, const string& path, const string& encoding) {
+        LIBSTRINGS_TRACE("st_save_async");
+
+        unsigned int code = LIBSTRINGS_OK;
+        string message;
+        if (op->cancel.is_set()) {
+            code = LIBSTRINGS_ERROR_CANCELLED;
+            message = "The save to \"" + path + "\" was cancelled.";
+        } else {
+            try {
+                snapshot->Save(path, encoding, 1, false, &op->cancel);
+            } catch (bad_alloc& e) {
+                code = LIBSTRINGS_ERROR_NO_MEM;
+                message = e.what();
+            } catch (error& e) {
+                code = e.code();
+                message = e.what();
+            } catch (exception& e) {
+                code = LIBSTRINGS_ERROR_FILE_WRITE_FAIL;
+                message = e.what();
+            } catch (...) {
+                code = LIBSTRINGS_ERROR_FILE_WRITE_FAIL;
+                message = "An unknown error occurred while saving to \"" + path + "\".";
+            }
+        }
+
+        delete snapshot;
+        op->Finish(code, message, NULL);
+    }
+}
+
+_strings_async_int::_strings_async_int(st_async_callback callback, void * context) :
+    _callback(callback),
+    _context(context),
+    _finished(false),
+    _done(false),
+    _code(LIBSTRINGS_OK),
+    _handle(NULL) {}
+
+_strings_async_int::~_strings_async_int() {
+    delete _handle;
+}
+
+void _strings_async_int::Finish(const unsigned int code, const string& message, _strings_handle_int * handle) {
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        _code = code;
+        _message = message;
+        _handle = handle;
+        _finished = true;
+    }
+
+    if (_callback != NULL)
+        _callback(this, code, _context);
+
+    //Notify while locked, as a waiter may free the operation as soon as it sees that it is done.
+    boost::mutex::scoped_lock lock(_mutex);
+    _done = true;
+    _doneCondition.notify_all();
+}
+
+bool _strings_async_int::IsDone() {
+    boost::mutex::scoped_lock lock(_mutex);
+    return _done;
+}
+
+void _strings_async_int::Wait() {
+    boost::mutex::scoped_lock lock(_mutex);
+    while (!_done)
+        _doneCondition.wait(lock);
+}
+
+bool _strings_async_int::GetResult(unsigned int& code, const char *& message, _strings_handle_int ** handle) {
+    boost::mutex::scoped_lock lock(_mutex);
+    if (!_finished)
+        return false;
+
+    code = _code;
+    message = _code == LIBSTRINGS_OK ? NULL : _message.c_str();
+    if (handle != NULL) {
+        *handle = _handle;
+        _handle = NULL;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_ASYNC_H__
+#define __LIBSTRINGS_ASYNC_H__
+
+#include "format.h"
+#include <string>
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace libstrings {
+    //Runs tasks on a fixed set of threads, in the order they are submitted. The threads are started when first needed.
+    void RunAsync(const boost::function<void ()>& task);
+
+    //Waits for the tasks already submitted to run, then stops the threads. Throws if called from one of them.
+    void StopAsync();
+}
+
+/* An open or save running on the library's worker threads. Its result is
+   recorded before the completion callback is called, and the operation is
+   only marked done once the callback returns, so that waiting for it also
+   waits for the callback. */
+struct _strings_async_int : boost::noncopyable {
+public:
+    _strings_async_int(st_async_callback callback, void * context);
+    ~_strings_async_int();
+
+    libstrings::cancel_flag cancel;
+
+    //Record the result, call the callback and mark the operation done. The handle is the one opened, if any.
+    void Finish(const unsigned int code, const std::string& message, _strings_handle_int * handle);
+
+    bool IsDone();
+    void Wait();
+
+    //Outputs the result, returning false if the operation hasn't finished yet. The opened handle is only output once, after which the client owns it. If handle is NULL, the opened handle is kept, to be closed with the operation if it isn't output later.
+    bool GetResult(unsigned int& code, const char *& message, _strings_handle_int ** handle);
+private:
+    st_async_callback _callback;
+    void * _context;
+
+    boost::mutex _mutex;
+    boost::condition_variable _doneCondition;
+    bool _finished;  //Set once the result is recorded.
+    bool _done;  //Set once the callback has returned.
+    unsigned int _code;
+    std::string _message;
+    _strings_handle_int * _handle;
+};
+
+namespace libstrings {
+    //The tasks run for each operation. The save's handle is a snapshot, which the task deletes.
+    void OpenTask(_strings_async_int * op, const std::string& path, const std::string& fallbackEncoding, const bool mapFile);
+    void SaveTask(_strings_async_int * op, _strings_handle_int * snapshot, const std::string& path, const std::string& encoding);
+}
+
+#endif
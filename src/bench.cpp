@@ -0,0 +1,495 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/* Benchmarks the library's main operations on synthetic strings files,
+   reporting their throughput and the memory allocations they make in a
+   machine-readable form, so that results can be compared between builds.
+
+   Usage: libstrings-bench [options]
+
+     --entries N         The number of strings with IDs in each file. (100000)
+     --min-length N      The shortest string length, in characters. (4)
+     --max-length N      The longest string length, in characters. (120)
+     --lengths TYPE      How lengths are spread between the two: "uniform",
+                         or "skewed" towards shorter strings. (skewed)
+     --duplicates R      The ratio of IDs that share another ID's string. (0.1)
+     --unreferenced R    The ratio of strings that have no ID, relative to
+                         the number of entries. (0.01)
+     --encoding TYPE     The characters strings are made of: "ascii",
+                         "1252" (Windows-1252 with high-bit characters),
+                         "1251" (Windows-1251 Cyrillic) or "utf8" (multi-
+                         byte UTF-8). (ascii)
+     --rounds N          The number of times each operation is timed, of
+                         which the fastest is reported. (5)
+     --seed N            The seed for generating strings. (1)
+     --dir PATH          The directory to write files to. (.)
+     --format TYPE       "json" or "csv". (json)
+
+   Allocations are counted by replacing the global operator new, so they
+   only include the library's allocations if it is linked statically or
+   shares the executable's allocator. */
+
+#include "libstrings.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread/mutex.hpp>
+
+using namespace std;
+
+namespace {
+    /* The library allocates on its worker threads too, so the counts are
+       guarded. The mutex is created on first use, as operator new can be
+       called during static initialisation, before globals are constructed. */
+    size_t allocCount = 0;
+    size_t allocBytes = 0;
+
+    boost::mutex& alloc_mutex() {
+        static boost::mutex mutex;
+        return mutex;
+    }
+
+    void * counted_alloc(const size_t size) {
+        {
+            boost::mutex::scoped_lock lock(alloc_mutex());
+            allocCount++;
+            allocBytes += size;
+        }
+        void * p = malloc(size == 0 ? 1 : size);
+        if (p == NULL)
+            throw bad_alloc();
+        return p;
+    }
+}
+
+void * operator new (size_t size) {
+    return counted_alloc(size);
+}
+
+void * operator new [] (size_t size) {
+    return counted_alloc(size);
+}
+
+void operator delete (void * p) throw() {
+    free(p);
+}
+
+void operator delete [] (void * p) throw() {
+    free(p);
+}
+
+void operator delete (void * p, size_t) throw() {
+    free(p);
+}
+
+void operator delete [] (void * p, size_t) throw() {
+    free(p);
+}
+
+namespace {
+    struct settings {
+        settings() :
+            entries(100000),
+            minLength(4),
+            maxLength(120),
+            skewed(true),
+            duplicates(0.1),
+            unreferenced(0.01),
+            encoding("ascii"),
+            rounds(5),
+            seed(1),
+            dir("."),
+            json(true) {}
+
+        size_t entries;
+        size_t minLength;
+        size_t maxLength;
+        bool skewed;
+        double duplicates;
+        double unreferenced;
+        string encoding;
+        size_t rounds;
+        uint32_t seed;
+        string dir;
+        bool json;
+    };
+
+    //A small deterministic generator, so that files are the same on every platform.
+    class random_source {
+    public:
+        random_source(const uint32_t seed) : _state(seed == 0 ? 1 : seed) {}
+
+        uint32_t next() {
+            _state ^= _state << 13;
+            _state ^= _state >> 17;
+            _state ^= _state << 5;
+            return _state;
+        }
+
+        //A value in [0, 1).
+        double fraction() {
+            return next() / 4294967296.0;
+        }
+
+        size_t between(const size_t min, const size_t max) {
+            return min + next() % (max - min + 1);
+        }
+    private:
+        uint32_t _state;
+    };
+
+    //Make a string of the given number of characters in the given encoding.
+    string make_string(random_source& rng, const size_t length, const string& encoding) {
+        string str;
+        for (size_t i=0; i < length; i++) {
+            if (rng.next() % 6 == 0) {
+                str += ' ';
+                continue;
+            }
+
+            if (encoding == "1252") {
+                //Mostly ASCII letters, with accented letters from the high half.
+                if (rng.next() % 4 == 0)
+                    str += (char)(0xE0 + rng.next() % 0x20);
+                else
+                    str += (char)('a' + rng.next() % 26);
+            } else if (encoding == "1251") {
+                str += (char)(0xC0 + rng.next() % 0x40);
+            } else if (encoding == "utf8") {
+                //Cyrillic (two bytes), CJK (three bytes) and the odd ASCII letter.
+                const uint32_t kind = rng.next() % 4;
+                if (kind == 0)
+                    str += (char)('a' + rng.next() % 26);
+                else if (kind == 3) {
+                    const uint32_t cp = 0x4E00 + rng.next() % 0x5000;
+                    str += (char)(0xE0 | (cp >> 12));
+                    str += (char)(0x80 | ((cp >> 6) & 0x3F));
+                    str += (char)(0x80 | (cp & 0x3F));
+                } else {
+                    const uint32_t cp = 0x410 + rng.next() % 0x40;
+                    str += (char)(0xC0 | (cp >> 6));
+                    str += (char)(0x80 | (cp & 0x3F));
+                }
+            } else
+                str += (char)('a' + rng.next() % 26);
+        }
+        return str;
+    }
+
+    size_t make_length(random_source& rng, const settings& s) {
+        if (!s.skewed)
+            return rng.between(s.minLength, s.maxLength);
+
+        //Multiplying two uniform values gives mostly short strings with a long tail, like game text.
+        const double f = rng.fraction() * rng.fraction();
+        return s.minLength + (size_t)(f * (s.maxLength - s.minLength + 1));
+    }
+
+    void put_uint32(string& out, const uint32_t value) {
+        for (size_t i=0; i < 4; i++)
+            out += (char)((value >> (8 * i)) & 0xFF);
+    }
+
+    //Generate a file in the given format, outputting the IDs it contains.
+    string generate(const settings& s, const bool dotStrings, vector<uint32_t>& ids) {
+        random_source rng(s.seed);
+        vector<uint32_t> offsets;
+        string data;
+
+        const size_t unrefCount = (size_t)(s.entries * s.unreferenced);
+        size_t unrefWritten = 0;
+
+        vector< pair<uint32_t, uint32_t> > directory;
+        uint32_t id = 1;
+        for (size_t i=0; i < s.entries; i++) {
+            //IDs are mostly sequential, with occasional gaps.
+            id += (rng.next() % 8 == 0) ? 2 + rng.next() % 64 : 1;
+
+            uint32_t offset;
+            if (!offsets.empty() && rng.fraction() < s.duplicates)
+                offset = offsets[rng.next() % offsets.size()];
+            else {
+                //Scatter unreferenced strings among the referenced ones.
+                while (unrefWritten < unrefCount && rng.fraction() * s.entries < unrefCount) {
+                    const string str = make_string(rng, make_length(rng, s), s.encoding);
+                    if (!dotStrings)
+                        put_uint32(data, str.length() + 1);
+                    data += str;
+                    data += '\0';
+                    unrefWritten++;
+                }
+
+                offset = data.size();
+                offsets.push_back(offset);
+                const string str = make_string(rng, make_length(rng, s), s.encoding);
+                if (!dotStrings)
+                    put_uint32(data, str.length() + 1);
+                data += str;
+                data += '\0';
+            }
+
+            directory.push_back(pair<uint32_t, uint32_t>(id, offset));
+            ids.push_back(id);
+        }
+
+        string file;
+        put_uint32(file, directory.size());
+        put_uint32(file, data.size());
+        for (size_t i=0; i < directory.size(); i++) {
+            put_uint32(file, directory[i].first);
+            put_uint32(file, directory[i].second);
+        }
+        return file + data;
+    }
+
+    struct result {
+        string file;
+        string operation;
+        size_t operations;
+        size_t bytes;
+        double seconds;
+        size_t allocations;
+        size_t allocatedBytes;
+    };
+
+    //Times an operation, which is rerun using a fresh state for each round.
+    class timer {
+    public:
+        void start() {
+            {
+                boost::mutex::scoped_lock lock(alloc_mutex());
+                _allocCount = allocCount;
+                _allocBytes = allocBytes;
+            }
+            _start = boost::posix_time::microsec_clock::universal_time();
+        }
+
+        void stop(result& r, const bool first) {
+            const double seconds = (boost::posix_time::microsec_clock::universal_time() - _start).total_microseconds() / 1e6;
+            if (first || seconds < r.seconds) {
+                boost::mutex::scoped_lock lock(alloc_mutex());
+                r.seconds = seconds;
+                r.allocations = allocCount - _allocCount;
+                r.allocatedBytes = allocBytes - _allocBytes;
+            }
+        }
+    private:
+        boost::posix_time::ptime _start;
+        size_t _allocCount;
+        size_t _allocBytes;
+    };
+
+    void fail(const char * what) {
+        const char * message = NULL;
+        st_get_error_message(&message);
+        fprintf(stderr, "%s failed: %s\n", what, message == NULL ? "unknown error" : message);
+        exit(1);
+    }
+
+    void check(const unsigned int code, const char * what) {
+        if (code != LIBSTRINGS_OK)
+            fail(what);
+    }
+
+    //Run each operation on the given file, adding their results to the list.
+    void bench_file(const settings& s, const string& ext, vector<result>& results) {
+        const string path = s.dir + "/bench" + ext;
+        const string savePath = s.dir + "/bench-saved" + ext;
+        const char * fallbackEncoding = s.encoding == "1251" ? "Windows-1251" : "Windows-1252";
+
+        vector<uint32_t> ids;
+        const string contents = generate(s, ext == ".STRINGS", ids);
+        FILE * f = fopen(path.c_str(), "wb");
+        if (f == NULL || fwrite(contents.data(), 1, contents.size(), f) != contents.size())
+            fail("Writing the generated file");
+        fclose(f);
+
+        //Look up strings in a random order, so that lookups don't just walk memory in order.
+        vector<uint32_t> lookups(ids);
+        random_source rng(s.seed + 1);
+        for (size_t i=lookups.size(); i > 1; i--)
+            swap(lookups[i - 1], lookups[rng.next() % i]);
+
+        const size_t edits = max((size_t)1, ids.size() / 10);
+        const char * operations[] = { "open", "get_string", "get_strings", "edit", "save" };
+        const size_t operationCount = sizeof(operations) / sizeof(operations[0]);
+        vector<result> fileResults(operationCount);
+        for (size_t i=0; i < operationCount; i++) {
+            fileResults[i].file = ext.substr(1);
+            fileResults[i].operation = operations[i];
+            fileResults[i].operations = 0;
+            fileResults[i].bytes = 0;
+            fileResults[i].seconds = 0;
+            fileResults[i].allocations = 0;
+            fileResults[i].allocatedBytes = 0;
+        }
+        fileResults[0].operations = 1;
+        fileResults[0].bytes = contents.size();
+        fileResults[1].operations = lookups.size();
+        fileResults[2].operations = 1;
+        fileResults[3].operations = 3 * edits;
+
+        for (size_t round=0; round < s.rounds; round++) {
+            const bool first = round == 0;
+            timer t;
+            st_strings_handle sh;
+
+            t.start();
+            check(st_open(&sh, path.c_str(), fallbackEncoding), "st_open");
+            t.stop(fileResults[0], first);
+
+            size_t stringBytes = 0;
+            char * str;
+            t.start();
+            for (size_t i=0; i < lookups.size(); i++) {
+                check(st_get_string(sh, lookups[i], &str), "st_get_string");
+                stringBytes += strlen(str);
+            }
+            t.stop(fileResults[1], first);
+            fileResults[1].bytes = stringBytes;
+
+            st_string_data * strings;
+            size_t numStrings;
+            t.start();
+            check(st_get_strings(sh, &strings, &numStrings), "st_get_strings");
+            t.stop(fileResults[2], first);
+            fileResults[2].bytes = 0;
+            for (size_t i=0; i < numStrings; i++)
+                fileResults[2].bytes += strlen(strings[i].data);
+
+            //Replace, add and remove a tenth as many strings as there are IDs.
+            t.start();
+            for (size_t i=0; i < edits; i++) {
+                check(st_replace_string(sh, lookups[i], "A replacement string."), "st_replace_string");
+                check(st_add_string(sh, 0x80000000 + (uint32_t)i, "An added string."), "st_add_string");
+                check(st_remove_string(sh, lookups[lookups.size() - 1 - i]), "st_remove_string");
+            }
+            t.stop(fileResults[3], first);
+
+            t.start();
+            check(st_save(sh, savePath.c_str(), "UTF-8"), "st_save");
+            t.stop(fileResults[4], first);
+
+            st_close(sh);
+        }
+
+        FILE * saved = fopen(savePath.c_str(), "rb");
+        if (saved != NULL) {
+            fseek(saved, 0, SEEK_END);
+            fileResults[4].bytes = ftell(saved);
+            fclose(saved);
+        }
+        fileResults[4].operations = 1;
+
+        remove(path.c_str());
+        remove(savePath.c_str());
+        results.insert(results.end(), fileResults.begin(), fileResults.end());
+    }
+
+    void print_json(const settings& s, const vector<result>& results) {
+        printf("{\n");
+        printf("  \"settings\": {\"entries\": %lu, \"minLength\": %lu, \"maxLength\": %lu, \"lengths\": \"%s\", \"duplicates\": %g, \"unreferenced\": %g, \"encoding\": \"%s\", \"rounds\": %lu, \"seed\": %lu},\n",
+            (unsigned long)s.entries, (unsigned long)s.minLength, (unsigned long)s.maxLength, s.skewed ? "skewed" : "uniform", s.duplicates, s.unreferenced, s.encoding.c_str(), (unsigned long)s.rounds, (unsigned long)s.seed);
+        printf("  \"results\": [\n");
+        for (size_t i=0; i < results.size(); i++) {
+            const result& r = results[i];
+            printf("    {\"file\": \"%s\", \"operation\": \"%s\", \"seconds\": %.6f, \"operations\": %lu, \"opsPerSecond\": %.1f, \"bytes\": %lu, \"megabytesPerSecond\": %.2f, \"allocations\": %lu, \"allocatedBytes\": %lu}%s\n",
+                r.file.c_str(), r.operation.c_str(), r.seconds, (unsigned long)r.operations, r.operations / r.seconds, (unsigned long)r.bytes, r.bytes / r.seconds / 1e6, (unsigned long)r.allocations, (unsigned long)r.allocatedBytes, i + 1 < results.size() ? "," : "");
+        }
+        printf("  ]\n}\n");
+    }
+
+    void print_csv(const vector<result>& results) {
+        printf("file,operation,seconds,operations,ops_per_second,bytes,megabytes_per_second,allocations,allocated_bytes\n");
+        for (size_t i=0; i < results.size(); i++) {
+            const result& r = results[i];
+            printf("%s,%s,%.6f,%lu,%.1f,%lu,%.2f,%lu,%lu\n",
+                r.file.c_str(), r.operation.c_str(), r.seconds, (unsigned long)r.operations, r.operations / r.seconds, (unsigned long)r.bytes, r.bytes / r.seconds / 1e6, (unsigned long)r.allocations, (unsigned long)r.allocatedBytes);
+        }
+    }
+
+    void usage_error(const string& message) {
+        fprintf(stderr, "%s\nSee the top of bench.cpp for usage.\n", message.c_str());
+        exit(2);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    settings s;
+    for (int i=1; i < argc; i++) {
+        const string arg = argv[i];
+        if (i + 1 == argc)
+            usage_error("Missing value for " + arg + ".");
+        const string value = argv[++i];
+
+        if (arg == "--entries")
+            s.entries = strtoul(value.c_str(), NULL, 10);
+        else if (arg == "--min-length")
+            s.minLength = strtoul(value.c_str(), NULL, 10);
+        else if (arg == "--max-length")
+            s.maxLength = strtoul(value.c_str(), NULL, 10);
+        else if (arg == "--lengths" && (value == "uniform" || value == "skewed"))
+            s.skewed = value == "skewed";
+        else if (arg == "--duplicates")
+            s.duplicates = atof(value.c_str());
+        else if (arg == "--unreferenced")
+            s.unreferenced = atof(value.c_str());
+        else if (arg == "--encoding" && (value == "ascii" || value == "1252" || value == "1251" || value == "utf8"))
+            s.encoding = value;
+        else if (arg == "--rounds")
+            s.rounds = max(1UL, strtoul(value.c_str(), NULL, 10));
+        else if (arg == "--seed")
+            s.seed = strtoul(value.c_str(), NULL, 10);
+        else if (arg == "--dir")
+            s.dir = value;
+        else if (arg == "--format" && (value == "json" || value == "csv"))
+            s.json = value == "json";
+        else
+            usage_error("Invalid option: " + arg + " " + value);
+    }
+
+    if (s.entries == 0 || s.minLength > s.maxLength)
+        usage_error("There must be at least one entry, and the minimum length can't be greater than the maximum.");
+
+    vector<result> results;
+    bench_file(s, ".STRINGS", results);
+    bench_file(s, ".DLSTRINGS", results);
+    bench_file(s, ".ILSTRINGS", results);
+
+    if (s.json)
+        print_json(s, results);
+    else
+        print_csv(results);
+
+    st_cleanup();
+
+    return 0;
+}
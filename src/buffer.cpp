@@ -0,0 +1,120 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "buffer.h"
+#include "libstrings.h"
+#include "error.h"
+#include "streams.h"
+
+using namespace std;
+
+namespace fs = boost::filesystem;
+
+namespace libstrings {
+
+    file_buffer::file_buffer() : _borrowed(NULL), _borrowedSize(0) {}
+
+    void file_buffer::read(const fs::path& path) {
+        close();
+        try {
+            libstrings::ifstream in(path, ios::binary);
+            in.exceptions(ios::failbit | ios::badbit | ios::eofbit);  //Causes ifstream::failure to be thrown if problem is encountered.
+
+            //Get the file's length.
+            in.seekg(0, ios::end);
+            size_t fileSize = in.tellg();
+
+            //Read whole file into memory.
+            _content.resize(fileSize);
+            in.seekg(0, ios::beg);
+            if (fileSize > 0)
+                in.read((char*)&_content[0], fileSize);
+
+            in.close();
+        } catch (bad_alloc& e) {
+            throw error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+        } catch (ios_base::failure& e) {
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path.string() + "\".");
+        }
+    }
+
+    void file_buffer::map(const fs::path& path) {
+        close();
+        try {
+            //Zero-length files can't be mapped, but there's nothing to map anyway.
+            if (fs::file_size(path) > 0)
+                _mapping.open(path);
+        } catch (fs::filesystem_error& e) {
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, e.what());
+        } catch (ios_base::failure& e) {
+            throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not map \"" + path.string() + "\" into memory.");
+        }
+    }
+
+    void file_buffer::assign(const uint8_t * data, const size_t size) {
+        close();
+        try {
+            _content.assign(data, data + size);
+        } catch (bad_alloc& e) {
+            throw error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+        }
+    }
+
+    void file_buffer::borrow(const uint8_t * data, const size_t size) {
+        close();
+        _borrowed = data;
+        _borrowedSize = size;
+    }
+
+    void file_buffer::close() {
+        vector<uint8_t>().swap(_content);
+        if (_mapping.is_open())
+            _mapping.close();
+        _borrowed = NULL;
+        _borrowedSize = 0;
+    }
+
+    const uint8_t * file_buffer::data() const {
+        if (_mapping.is_open())
+            return reinterpret_cast<const uint8_t*>(_mapping.data());
+        else if (_borrowed != NULL)
+            return _borrowed;
+        else if (!_content.empty())
+            return &_content[0];
+        else
+            return NULL;
+    }
+
+    size_t file_buffer::size() const {
+        if (_mapping.is_open())
+            return _mapping.size();
+        else if (_borrowed != NULL)
+            return _borrowedSize;
+        else
+            return _content.size();
+    }
+
+    bool file_buffer::is_mapped() const {
+        return _mapping.is_open();
+    }
+}
@@ -0,0 +1,60 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_BUFFER_H__
+#define __LIBSTRINGS_BUFFER_H__
+
+#include <stdint.h>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace libstrings {
+
+    /* Holds the raw contents of a strings file. The contents are either read
+       into memory, or the file is mapped read-only, in which case the file
+       must not be modified while the buffer is open. Contents that are
+       already in memory can also be copied, or borrowed, in which case they
+       must outlive the buffer and not be modified while it is open. */
+    class file_buffer {
+    public:
+        file_buffer();
+
+        void read(const boost::filesystem::path& path);
+        void map(const boost::filesystem::path& path);
+        void assign(const uint8_t * data, const size_t size);
+        void borrow(const uint8_t * data, const size_t size);
+        void close();
+
+        const uint8_t * data() const;
+        size_t size() const;
+        bool is_mapped() const;
+    private:
+        std::vector<uint8_t> _content;
+        boost::iostreams::mapped_file_source _mapping;
+        const uint8_t * _borrowed;
+        size_t _borrowedSize;
+    };
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "bundle.h"
+#include "libstrings.h"
+#include "error.h"
+#include <new>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace libstrings;
+
+namespace {
+    //The extensions of the files in a bundle, indexed by file type.
+    const char * const extensions[] = { ".STRINGS", ".DLSTRINGS", ".ILSTRINGS" };
+
+    /* The outcome of a task run on another thread. Exceptions can't cross
+       threads, so they are caught and held until the task is joined. */
+    struct task_result {
+        task_result() : failed(false), code(LIBSTRINGS_OK) {}
+
+        bool failed;
+        unsigned int code;
+        string what;
+    };
+
+    void open_file(_strings_handle_int *& handle, const string& path, const string& fallbackEncoding, const bool mapFile, task_result& result) {
+        try {
+            handle = new _strings_handle_int(path, fallbackEncoding, mapFile);
+        } catch (bad_alloc& e) {
+            result.failed = true;
+            result.code = LIBSTRINGS_ERROR_NO_MEM;
+            result.what = e.what();
+        } catch (error& e) {
+            result.failed = true;
+            result.code = e.code();
+            result.what = e.what();
+        } catch (exception& e) {
+            //Anything else, e.g. a filesystem_error, would otherwise terminate the program when it escaped the thread.
+            result.failed = true;
+            result.code = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+            result.what = e.what();
+        } catch (...) {
+            result.failed = true;
+            result.code = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+            result.what = "An unknown error occurred while opening \"" + path + "\".";
+        }
+    }
+
+    void save_file(_strings_handle_int * handle, const string& path, const string& encoding, task_result& result) {
+        try {
+            //Other threads may be reading a handle in concurrent mode, as they can while st_save() saves it.
+            handle_lock lock(handle, true);
+            handle->Save(path, encoding);
+        } catch (bad_alloc& e) {
+            result.failed = true;
+            result.code = LIBSTRINGS_ERROR_NO_MEM;
+            result.what = e.what();
+        } catch (error& e) {
+            result.failed = true;
+            result.code = e.code();
+            result.what = e.what();
+        } catch (exception& e) {
+            result.failed = true;
+            result.code = LIBSTRINGS_ERROR_FILE_WRITE_FAIL;
+            result.what = e.what();
+        } catch (...) {
+            result.failed = true;
+            result.code = LIBSTRINGS_ERROR_FILE_WRITE_FAIL;
+            result.what = "An unknown error occurred while saving to \"" + path + "\".";
+        }
+    }
+
+    //Throw the error of the first file that failed, if any did.
+    void check_results(const task_result * results, const size_t count) {
+        for (size_t i=0; i < count; i++) {
+            if (results[i].failed)
+                throw error(results[i].code, results[i].what);
+        }
+    }
+}
+
+_strings_bundle_int::_strings_bundle_int(const string& basePath, const string& fallbackEncoding, const bool mapFiles) {
+    for (size_t i=0; i < fileCount; i++)
+        handles[i] = NULL;
+
+    //Each file is read on its own thread, so that reading one overlaps with parsing the others.
+    task_result results[fileCount];
+    boost::thread_group group;
+    size_t started = 0;
+    try {
+        for (; started < fileCount; started++)
+            group.create_thread(boost::bind(&open_file, boost::ref(handles[started]), basePath + extensions[started], boost::cref(fallbackEncoding), mapFiles, boost::ref(results[started])));
+    } catch (boost::thread_resource_error&) {
+        //Open the files that didn't get a thread on this one.
+    }
+    for (size_t i=started; i < fileCount; i++)
+        open_file(handles[i], basePath + extensions[i], fallbackEncoding, mapFiles, results[i]);
+    group.join_all();
+
+    try {
+        check_results(results, fileCount);
+    } catch (error& e) {
+        for (size_t i=0; i < fileCount; i++)
+            delete handles[i];
+        throw;
+    }
+}
+
+_strings_bundle_int::~_strings_bundle_int() {
+    for (size_t i=0; i < fileCount; i++)
+        delete handles[i];
+}
+
+void _strings_bundle_int::Save(const string& basePath, const string& encoding) {
+    task_result results[fileCount];
+    boost::thread_group group;
+    size_t started = 0;
+    try {
+        for (; started < fileCount; started++)
+            group.create_thread(boost::bind(&save_file, handles[started], basePath + extensions[started], boost::cref(encoding), boost::ref(results[started])));
+    } catch (boost::thread_resource_error&) {
+        //Save the files that didn't get a thread on this one.
+    }
+    for (size_t i=started; i < fileCount; i++)
+        save_file(handles[i], basePath + extensions[i], encoding, results[i]);
+    group.join_all();
+
+    check_results(results, fileCount);
+}
@@ -0,0 +1,48 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_BUNDLE_H__
+#define __LIBSTRINGS_BUNDLE_H__
+
+#include "format.h"
+#include <string>
+
+/* The STRINGS, DLSTRINGS and ILSTRINGS files of a plugin, which are opened
+   and saved together. Each file gets its own handle, indexed by file type,
+   so that all the functions that act on handles can be used on them. The
+   files are read and written concurrently, one thread per file. */
+struct _strings_bundle_int {
+public:
+    static const unsigned int fileCount = 3;
+
+    //The base path is the path of the files without their extensions, e.g. "Strings/Skyrim_English".
+    _strings_bundle_int(const std::string& basePath, const std::string& fallbackEncoding, const bool mapFiles);
+    ~_strings_bundle_int();
+
+    _strings_handle_int * handles[fileCount];
+
+    //Save all three files to the given base path.
+    void Save(const std::string& basePath, const std::string& encoding);
+};
+
+#endif
@@ -0,0 +1,155 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/* Checks the built-in codepage tables against boost::locale, by decoding
+   every byte in each codepage both ways, and checking that every character
+   a codepage decodes to is encoded back to the same byte, by the tables and
+   by boost::locale.
+   Usage: libstrings-codepage-test
+   Exits with a non-zero status if the tables and boost::locale disagree. */
+
+#include "codepages.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+
+#include <boost/locale.hpp>
+
+using namespace std;
+using namespace libstrings;
+
+namespace {
+    const char * const encodings[] = { "Windows-1250", "Windows-1251", "Windows-1252" };
+    const size_t encodingCount = sizeof(encodings) / sizeof(encodings[0]);
+
+    struct test_state {
+        test_state() : checks(0), failures(0) {}
+
+        size_t checks;
+        size_t failures;
+    };
+
+    void print_hex(const string& str) {
+        for (size_t i=0; i < str.length(); i++)
+            printf("%02X", (unsigned int)(uint8_t)str[i]);
+    }
+
+    void check(test_state& state, const bool passed, const char * encoding, const uint8_t byte, const char * what) {
+        state.checks++;
+        if (!passed) {
+            state.failures++;
+            if (state.failures <= 20)
+                printf("FAILED: %s byte %02X: %s\n", encoding, (unsigned int)byte, what);
+        }
+    }
+
+    //Returns false if boost::locale can't convert the string.
+    bool locale_decode(const string& str, const char * encoding, string& out) {
+        try {
+            out = boost::locale::conv::to_utf<char>(str, encoding, boost::locale::conv::stop);
+            return true;
+        } catch (boost::locale::conv::conversion_error&) {
+            return false;
+        }
+    }
+
+    bool locale_encode(const string& str, const char * encoding, string& out) {
+        try {
+            out = boost::locale::conv::from_utf<char>(str, encoding, boost::locale::conv::stop);
+            return true;
+        } catch (boost::locale::conv::conversion_error&) {
+            return false;
+        }
+    }
+
+    void check_codepage(test_state& state, const char * encoding) {
+        const codepage * cp = codepage::get(encoding);
+        if (cp == NULL) {
+            check(state, false, encoding, 0, "there is no built-in codepage");
+            return;
+        }
+
+        for (unsigned int i=0; i < 256; i++) {
+            const uint8_t byte = i;
+            const string str(1, (char)byte);
+
+            string decoded, expected;
+            const bool canDecode = cp->decode(str.data(), str.length(), decoded);
+            const bool localeCanDecode = locale_decode(str, encoding, expected);
+            check(state, canDecode == localeCanDecode, encoding, byte, canDecode ? "decoded, but boost::locale can't decode it" : "not decoded, but boost::locale can decode it");
+            if (!canDecode || !localeCanDecode)
+                continue;
+
+            if (decoded != expected) {
+                check(state, false, encoding, byte, "decoded differently to boost::locale");
+                printf("    tables: ");
+                print_hex(decoded);
+                printf(", boost::locale: ");
+                print_hex(expected);
+                printf("\n");
+                continue;
+            }
+
+            string encoded;
+            check(state, cp->encode(decoded.data(), decoded.length(), encoded) && encoded == str, encoding, byte, "the decoded character isn't encoded back to the byte");
+            check(state, locale_encode(decoded, encoding, encoded) && encoded == str, encoding, byte, "boost::locale doesn't encode the decoded character back to the byte");
+        }
+
+        //A string of every decodable byte must survive a round trip whole, using the buffer overload too.
+        string all;
+        for (unsigned int i=1; i < 256; i++) {
+            string decoded;
+            const string str(1, (char)i);
+            if (cp->decode(str.data(), str.length(), decoded))
+                all += str;
+        }
+        string decoded, encoded;
+        check(state, cp->decode(all.data(), all.length(), decoded), encoding, 0, "a string of every decodable byte wasn't decoded");
+        check(state, cp->encode(decoded.data(), decoded.length(), encoded) && encoded == all, encoding, 0, "a string of every decodable byte didn't survive a round trip");
+
+        string buffer(decoded.length(), '\0');
+        size_t length = 0;
+        check(state, cp->encode(decoded.data(), decoded.length(), &buffer[0], length) && buffer.substr(0, length) == all, encoding, 0, "encoding into a buffer gave a different result");
+
+        //No single-byte codepage has CJK characters or characters outside the BMP, and malformed UTF-8 can't be encoded.
+        check(state, !cp->encode("\xE4\xB8\xAD", 3, encoded), encoding, 0, "a CJK character was encoded");
+        check(state, !cp->encode("\xF0\x9F\x98\x80", 4, encoded), encoding, 0, "a character outside the BMP was encoded");
+        check(state, !cp->encode("\xC3", 1, encoded), encoding, 0, "a truncated sequence was encoded");
+        check(state, !cp->encode("\xC0\xA9", 2, encoded), encoding, 0, "an overlong sequence was encoded");
+    }
+}
+
+int main() {
+    test_state state;
+    for (size_t i=0; i < encodingCount; i++)
+        check_codepage(state, encodings[i]);
+
+    if (state.failures > 0) {
+        printf("FAILED: %u of %u checks\n", (unsigned int)state.failures, (unsigned int)state.checks);
+        return 1;
+    }
+
+    printf("All %u checks passed.\n", (unsigned int)state.checks);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_CODEPAGES_H__
+#define __LIBSTRINGS_CODEPAGES_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace libstrings {
+
+    /* Converts between UTF-8 and a single-byte Windows codepage using lookup
+       tables, so that a whole string is converted in one pass. Bytes below
+       0x80 are ASCII in all the supported codepages. */
+    class codepage {
+    public:
+        //toUnicode holds the code points for bytes 0x80 to 0xFF, with 0 for undefined bytes.
+        codepage(const uint16_t * toUnicode);
+
+        //Gets the built-in codepage for the given encoding, or NULL if there isn't one.
+        static const codepage * get(const std::string& encoding);
+
+        //Both return false if the input contains bytes or characters that can't be converted.
+        bool decode(const char * str, const size_t length, std::string& out) const;
+        bool encode(const char * str, const size_t length, std::string& out) const;
+
+        //Encodes into a buffer of at least the input's length, as encoding never lengthens a string, outputting the encoded length.
+        bool encode(const char * str, const size_t length, char * out, size_t& outLength) const;
+    private:
+        struct utf8_char {
+            uint8_t length;
+            char bytes[3];
+        };
+
+        //Decoding table, indexed by byte - 0x80.
+        utf8_char _toUTF8[128];
+
+        //Encoding table, in 256-entry pages indexed by the code point's high byte. Page 0 is empty.
+        uint16_t _pageIndex[256];
+        std::vector<uint8_t> _pages;
+    };
+}
+
+#endif
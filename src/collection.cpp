@@ -0,0 +1,124 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "collection.h"
+#include "libstrings.h"
+#include "error.h"
+#include <new>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace libstrings;
+
+namespace fs = boost::filesystem;
+
+_strings_collection_int::entry::entry(const string& path) :
+    path(path),
+    handle(NULL),
+    code(LIBSTRINGS_OK) {}
+
+_strings_collection_int::_strings_collection_int(const vector<string>& paths, const string& fallbackEncoding, const bool mapFiles, unsigned int threads) :
+    fallbackEncoding(fallbackEncoding),
+    mapFiles(mapFiles),
+    next(0) {
+
+    entries.reserve(paths.size());
+    for (size_t i=0; i < paths.size(); i++)
+        entries.push_back(entry(paths[i]));
+
+    if (threads == 0)
+        threads = boost::thread::hardware_concurrency();
+    threads = (unsigned int)min((size_t)max(threads, 1U), entries.size());
+
+    //The calling thread loads files too, so only create threads for the rest.
+    boost::thread_group group;
+    try {
+        for (unsigned int i=1; i < threads; i++)
+            group.create_thread(boost::bind(&_strings_collection_int::LoadFiles, this));
+    } catch (boost::thread_resource_error&) {
+        //Make do with the threads that could be created.
+    }
+    LoadFiles();
+    group.join_all();
+}
+
+_strings_collection_int::~_strings_collection_int() {
+    for (size_t i=0; i < entries.size(); i++)
+        delete entries[i].handle;
+}
+
+void _strings_collection_int::LoadFiles() {
+    while (true) {
+        size_t i;
+        {
+            boost::mutex::scoped_lock lock(nextMutex);
+            if (next == entries.size())
+                return;
+            i = next++;
+        }
+
+        entry& file = entries[i];
+        //Anything thrown must be caught, as it would otherwise terminate the program when it escaped the thread.
+        try {
+            //Unlike st_open(), a collection is only for loading files, so it doesn't make handles for new ones.
+            if (!fs::exists(file.path)) {
+                file.code = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+                file.message = "\"" + file.path + "\" does not exist.";
+                continue;
+            }
+            file.handle = new _strings_handle_int(file.path, fallbackEncoding, mapFiles);
+        } catch (bad_alloc& e) {
+            file.code = LIBSTRINGS_ERROR_NO_MEM;
+            file.message = e.what();
+        } catch (error& e) {
+            file.code = e.code();
+            file.message = e.what();
+        } catch (exception& e) {
+            file.code = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+            file.message = e.what();
+        } catch (...) {
+            file.code = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+            file.message = "An unknown error occurred while loading \"" + file.path + "\".";
+        }
+    }
+}
+
+vector<string> _strings_collection_int::ListDirectory(const string& path) {
+    vector<string> paths;
+    try {
+        for (fs::directory_iterator it(path), endIt; it != endIt; ++it) {
+            const string ext = it->path().extension().string();
+            if (fs::is_regular_file(it->status()) && (boost::iequals(ext, ".strings") || boost::iequals(ext, ".ilstrings") || boost::iequals(ext, ".dlstrings")))
+                paths.push_back(it->path().string());
+        }
+    } catch (fs::filesystem_error& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, e.what());
+    }
+
+    sort(paths.begin(), paths.end());
+    return paths;
+}
@@ -0,0 +1,68 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_COLLECTION_H__
+#define __LIBSTRINGS_COLLECTION_H__
+
+#include "format.h"
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+/* A set of strings files loaded together, e.g. all those in a game's
+   Data/Strings directory. Files are loaded by a pool of threads that each
+   take the next file to load until none are left, so that a few large
+   files don't hold up the rest. A file that fails to load doesn't stop the
+   others from loading: its error is recorded alongside it instead. */
+struct _strings_collection_int {
+public:
+    struct entry {
+        entry(const std::string& path);
+
+        std::string path;
+        _strings_handle_int * handle;  //NULL if the file couldn't be loaded.
+        unsigned int code;
+        std::string message;
+    };
+
+    //If threads is 0, the number of hardware threads is used.
+    _strings_collection_int(const std::vector<std::string>& paths, const std::string& fallbackEncoding, const bool mapFiles, unsigned int threads);
+    ~_strings_collection_int();
+
+    //Lists the strings files in the given directory, in path order.
+    static std::vector<std::string> ListDirectory(const std::string& path);
+
+    std::vector<entry> entries;
+private:
+    //Load the files not yet taken by another thread.
+    void LoadFiles();
+
+    std::string fallbackEncoding;
+    bool mapFiles;
+
+    //The index of the next file to be loaded.
+    boost::mutex nextMutex;
+    size_t next;
+};
+
+#endif
@@ -0,0 +1,244 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/* Reads strings from a handle in concurrent mode on several threads, while
+   another thread replaces strings and saves the handle, checking that every
+   string read is one that the handle held, that the strings each thread is
+   given aren't freed by other threads, and that each thread gets its own
+   error messages. It is most useful when built with a thread sanitiser.
+   Usage: libstrings-concurrency-test [directory] [readers] [iterations]
+   The files are written to the given directory, or the working directory
+   if none is given. Exits with a non-zero status if any check fails. */
+
+#include "libstrings.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+namespace {
+    const uint32_t stringCount = 200;
+
+    struct test_state {
+        test_state() : checks(0), failures(0) {}
+
+        boost::mutex mutex;
+        size_t checks;
+        size_t failures;
+        string dir;
+    };
+
+    void check(test_state& state, const bool passed, const char * test, const char * what) {
+        boost::mutex::scoped_lock lock(state.mutex);
+        state.checks++;
+        if (!passed) {
+            state.failures++;
+            if (state.failures <= 20)
+                printf("FAILED: %s: %s\n", test, what);
+        }
+    }
+
+    bool check_code(test_state& state, const unsigned int code, const char * test, const char * what) {
+        check(state, code == LIBSTRINGS_OK, test, what);
+        if (code != LIBSTRINGS_OK) {
+            const char * details = NULL;
+            st_get_error_message(&details);
+            boost::mutex::scoped_lock lock(state.mutex);
+            printf("    error %u: %s\n", code, details == NULL ? "" : details);
+        }
+        return code == LIBSTRINGS_OK;
+    }
+
+    string file_path(const test_state& state, const string& name) {
+        return state.dir + "/" + name;
+    }
+
+    void write_file(const string& path, const string& contents) {
+        ofstream out(path.c_str(), ios::binary | ios::trunc);
+        out.write(contents.data(), contents.size());
+    }
+
+    void put_uint32(string& out, const uint32_t value) {
+        for (size_t i=0; i < 4; i++)
+            out += (char)((value >> (8 * i)) & 0xFF);
+    }
+
+    string original_string(const uint32_t id) {
+        char str[32];
+        sprintf(str, "String %u", (unsigned int)id);
+        return str;
+    }
+
+    string replaced_string(const uint32_t id, const unsigned int round) {
+        char str[48];
+        sprintf(str, "String %u replaced %u", (unsigned int)id, round);
+        return str;
+    }
+
+    //Whether the string is one that the given ID has held: its original string, or one it has been replaced with.
+    bool is_valid_string(const uint32_t id, const char * str) {
+        if (str == NULL)
+            return false;
+        const string value = str;
+        const string original = original_string(id);
+        return value == original || value.compare(0, original.length() + 10, original + " replaced ") == 0;
+    }
+
+    //A STRINGS file with one unreferenced string, which needs transcoding.
+    void write_source(const string& path) {
+        string directory, data;
+        for (uint32_t id=1; id <= stringCount; id++) {
+            put_uint32(directory, id);
+            put_uint32(directory, (uint32_t)data.size());
+            data += original_string(id);
+            data += '\0';
+        }
+        data += "Orphan caf\xE9";
+        data += '\0';
+
+        string file;
+        put_uint32(file, stringCount);
+        put_uint32(file, (uint32_t)data.size());
+        write_file(path, file + directory + data);
+    }
+
+    void read_strings(test_state& state, st_strings_handle sh, const string& corruptPath, const unsigned int seed, const unsigned int iterations) {
+        const char * test = "reader";
+        unsigned int random = seed;
+        for (unsigned int i=0; i < iterations; i++) {
+            //This thread's error names its own file, whatever errors other threads get meanwhile.
+            st_strings_handle corrupt = NULL;
+            check(state, st_open(&corrupt, corruptPath.c_str(), "Windows-1252") == LIBSTRINGS_ERROR_FILE_READ_FAIL, test, "a corrupt file was opened");
+
+            random = random * 1103515245 + 12345;
+            const uint32_t id = 1 + (random >> 16) % stringCount;
+            char * str = NULL;
+            if (check_code(state, st_get_string(sh, id, &str), test, "getting a string"))
+                check(state, is_valid_string(id, str), test, "a string read isn't one its ID has held");
+            const string copy = str == NULL ? "" : str;
+
+            st_string_data * strings = NULL;
+            size_t count = 0;
+            if (check_code(state, st_get_strings(sh, &strings, &count), test, "getting strings")) {
+                check(state, count == stringCount, test, "the wrong number of strings was read");
+                for (size_t j=0; j < count; j++) {
+                    if (!is_valid_string(strings[j].id, strings[j].data)) {
+                        check(state, false, test, "a string read with all the others isn't one its ID has held");
+                        break;
+                    }
+                }
+            }
+
+            char ** unref = NULL;
+            if (check_code(state, st_get_unref_strings(sh, &unref, &count), test, "getting unreferenced strings"))
+                check(state, count == 1 && string(unref[0]) == "Orphan caf\xC3\xA9", test, "the unreferenced strings differ from those in the file");
+
+            //Strings output to this thread stay valid until it next calls the same function.
+            check(state, str != NULL && copy == str, test, "a string output to this thread was changed by another");
+
+            const char * message = NULL;
+            st_get_error_message(&message);
+            check(state, message != NULL && string(message).find(corruptPath) != string::npos, test, "this thread's error message was overwritten by another thread's");
+        }
+        st_cleanup();
+    }
+
+    void write_strings(test_state& state, st_strings_handle sh, const string& savePath, const unsigned int iterations) {
+        const char * test = "writer";
+        for (unsigned int i=0; i < iterations; i++) {
+            const uint32_t id = 1 + (i * 7) % stringCount;
+            check_code(state, st_replace_string(sh, id, replaced_string(id, i).c_str()), test, "replacing a string");
+            if (i % 16 == 0)
+                check_code(state, st_save(sh, savePath.c_str(), "Windows-1252"), test, "saving the handle");
+        }
+        st_cleanup();
+    }
+}
+
+int main(int argc, char * argv[]) {
+    test_state state;
+    state.dir = argc > 1 ? argv[1] : ".";
+    const unsigned int readers = argc > 2 ? strtoul(argv[2], NULL, 10) : 4;
+    const unsigned int iterations = argc > 3 ? strtoul(argv[3], NULL, 10) : 2000;
+
+    const string path = file_path(state, "concurrency-test.STRINGS");
+    const string savePath = file_path(state, "concurrency-test-saved.STRINGS");
+    write_source(path);
+
+    st_strings_handle sh = NULL;
+    if (!check_code(state, st_open(&sh, path.c_str(), "Windows-1252"), "setup", "opening the file"))
+        return 1;
+    check_code(state, st_set_concurrent(sh, true), "setup", "enabling concurrent mode");
+
+    //Each reader has its own corrupt file, so that its errors can be told apart from others'.
+    vector<string> corruptPaths;
+    for (unsigned int i=0; i < readers; i++) {
+        char name[64];
+        sprintf(name, "concurrency-test-corrupt-%u.STRINGS", i);
+        corruptPaths.push_back(file_path(state, name));
+        string corrupt;
+        put_uint32(corrupt, 100);
+        put_uint32(corrupt, 0);
+        write_file(corruptPaths.back(), corrupt);
+    }
+
+    boost::thread_group group;
+    for (unsigned int i=0; i < readers; i++)
+        group.create_thread(boost::bind(&read_strings, boost::ref(state), sh, boost::cref(corruptPaths[i]), i + 1, iterations));
+    group.create_thread(boost::bind(&write_strings, boost::ref(state), sh, boost::cref(savePath), iterations));
+    group.join_all();
+
+    //Once the threads are done, the saved file holds the handle's strings.
+    check_code(state, st_save(sh, savePath.c_str(), "Windows-1252"), "result", "saving the handle");
+    st_strings_handle saved = NULL;
+    if (check_code(state, st_open(&saved, savePath.c_str(), "Windows-1252"), "result", "reopening the saved file")) {
+        for (uint32_t id=1; id <= stringCount; id++) {
+            char * expected = NULL;
+            char * str = NULL;
+            if (check_code(state, st_get_string(sh, id, &expected), "result", "getting a string") && check_code(state, st_get_string(saved, id, &str), "result", "getting a saved string")) {
+                check(state, is_valid_string(id, expected), "result", "a string isn't one its ID has held");
+                check(state, string(expected) == str, "result", "a string read back differs from that saved");
+            }
+        }
+        st_close(saved);
+    }
+    st_close(sh);
+    st_cleanup();
+
+    if (state.failures > 0) {
+        printf("FAILED: %u of %u checks\n", (unsigned int)state.failures, (unsigned int)state.checks);
+        return 1;
+    }
+
+    printf("All %u checks passed.\n", (unsigned int)state.checks);
+    return 0;
+}
@@ -26,24 +26,609 @@
 #include "error.h"
 #include "helpers.h"
 #include "streams.h"
+#include "trace.h"
+#include "codepages.h"
 #include <cstdio>
-#include <sstream>
+#include <cstring>
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 using namespace libstrings;
 
 namespace fs = boost::filesystem;
 
-_strings_handle_int::_strings_handle_int(const string& path, const string& fallbackEncoding) :
-    extStringDataArr(NULL),
-    extStringArr(NULL),
-    extString(NULL),
-    extStringDataArrSize(0),
-    extStringArrSize(0) {
+namespace libstrings {
+    const uint32_t string_entry::noOffset;
 
-    bool isDotStrings;
+    string_entry::string_entry() : _str(""), _raw(NULL), _length(0), _rawLength(0), _offset(noOffset), _decoded(true) {}
+
+    //Strings that haven't been decoded yet were read from a file, so are their own raw bytes.
+    string_entry::string_entry(const char * str, const size_t length, const bool decoded, const uint32_t offset) :
+        _str(str), _raw(decoded ? NULL : str), _length(length), _rawLength(decoded ? 0 : length), _offset(offset), _decoded(decoded) {}
+
+    const char * string_entry::c_str() const {
+        return _str;
+    }
+
+    size_t string_entry::length() const {
+        return _length;
+    }
+
+    std::string string_entry::str() const {
+        return string(_str, _length);
+    }
+
+    bool string_entry::is_decoded() const {
+        return _decoded;
+    }
+
+    uint32_t string_entry::offset() const {
+        return _offset;
+    }
+
+    void string_entry::set_offset(const uint32_t offset) {
+        _offset = offset;
+    }
+
+    const char * string_entry::raw() const {
+        return _raw;
+    }
+
+    size_t string_entry::raw_length() const {
+        return _rawLength;
+    }
+
+    void string_entry::decode(const std::string& fallbackEncoding, string_arena& arena, st_stats * stats) {
+        if (_decoded)
+            return;
+
+        //Stats are only updated once a decode succeeds, as a failed decode may be retried by concurrent readers.
+        const uint64_t start = stats == NULL ? 0 : now_ns();
+        bool transcoded = false;
+        if (!boost::iequals("UTF-8", fallbackEncoding) && !IsValidUTF8(_str, _length)) {
+            const string str = ToUTF8(string(_str, _length), fallbackEncoding);
+            _str = arena.store(str.data(), str.length());
+            _length = str.length();
+            transcoded = true;
+        }
+
+        _decoded = true;
+
+        if (stats != NULL) {
+            stats->decodeTime += now_ns() - start;
+            if (transcoded)
+                stats->stringsTranscoded++;
+            else
+                stats->stringsPassedThrough++;
+        }
+    }
+
+    void string_entry::move_to(string_arena& arena, const char * begin, const char * end, const bool inside) {
+        const bool shared = _raw == _str;
+        if ((_str >= begin && _str < end) == inside)
+            _str = arena.store(_str, _length);
+
+        if (shared)
+            _raw = _str;
+        else if (_raw != NULL && (_raw >= begin && _raw < end) == inside)
+            _raw = arena.store(_raw, _rawLength);
+    }
+
+    output_buffers::output_buffers() :
+        stringDataArr(NULL),
+        stringArr(NULL),
+        string(NULL),
+        stringDataArrSize(0),
+        stringArrSize(0) {}
+
+    output_buffers::~output_buffers() {
+        FreeString();
+        FreeStringDataArr();
+        FreeStringArr();
+    }
+
+    void output_buffers::FreeString() {
+        if (string != NULL) {
+            delete [] string;
+            string = NULL;
+        }
+    }
+
+    void output_buffers::FreeStringDataArr() {
+        if (stringDataArr != NULL) {
+            for (size_t i=0; i < stringDataArrSize; i++)
+                delete [] stringDataArr[i].data;
+            delete [] stringDataArr;
+            stringDataArr = NULL;
+            stringDataArrSize = 0;
+        }
+    }
+
+    void output_buffers::FreeStringArr() {
+        if (stringArr != NULL) {
+            for (size_t i=0; i < stringArrSize; i++)
+                delete [] stringArr[i];
+            delete [] stringArr;
+            stringArr = NULL;
+            stringArrSize = 0;
+        }
+    }
+
+    cancel_flag::cancel_flag() : _set(false) {}
+
+    void cancel_flag::set() {
+        boost::mutex::scoped_lock lock(_mutex);
+        _set = true;
+    }
+
+    bool cancel_flag::is_set() const {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _set;
+    }
+
+    handle_lock::handle_lock(_strings_handle_int * sh, const bool exclusive) :
+        _mutex(sh->concurrent ? &sh->mutex : NULL),
+        _exclusive(exclusive) {
+        if (_mutex == NULL)
+            return;
+        if (_exclusive)
+            _mutex->lock();
+        else
+            _mutex->lock_shared();
+    }
+
+    handle_lock::~handle_lock() {
+        if (_mutex == NULL)
+            return;
+        if (_exclusive)
+            _mutex->unlock();
+        else
+            _mutex->unlock_shared();
+    }
+}
+
+namespace {
+    //A view of a string that can be used as a hash map key, so that strings can be compared without being copied.
+    struct string_ref {
+        string_ref(const char * data, const size_t length) : data(data), length(length) {}
+
+        bool operator == (const string_ref& other) const {
+            return length == other.length && memcmp(data, other.data, length) == 0;
+        }
+
+        const char * data;
+        size_t length;
+    };
+
+    size_t hash_value(const string_ref& str) {
+        return boost::hash_range(str.data, str.data + str.length);
+    }
+
+    //The space an entry takes up in an arena, given where the source it may point into is.
+    size_t arena_size(const string_entry& entry, const char * sourceStart, const char * sourceEnd) {
+        size_t size = 0;
+        if (entry.c_str() < sourceStart || entry.c_str() >= sourceEnd)
+            size += entry.length() + 1;
+        if (entry.raw() != NULL && entry.raw() != entry.c_str() && (entry.raw() < sourceStart || entry.raw() >= sourceEnd))
+            size += entry.raw_length() + 1;
+        return size;
+    }
+
+    //The smallest number of directory entries worth giving a thread to read.
+    const size_t minEntriesPerThread = 4096;
+
+    //A run of directory entries read by one thread.
+    struct directory_chunk {
+        directory_chunk() : begin(0), end(0), collectStats(false), stats(), errorCode(LIBSTRINGS_OK) {}
+
+        size_t begin;
+        size_t end;
+        vector< pair<uint32_t, string_entry> > entries;
+        vector<uint32_t> offsets;
+        string_arena arena;
+
+        //Decodes are counted per chunk, and added to the handle's stats once the chunks are merged.
+        bool collectStats;
+        st_stats stats;
+
+        unsigned int errorCode;
+        string errorMessage;
+    };
+
+    //The smallest number of unique strings worth giving a thread to encode when saving.
+    const size_t minStringsPerThread = 1024;
+
+    //A run of unique strings encoded by one thread when saving, which are replaced by views of their encoded forms in the chunk's arena.
+    struct encoding_chunk {
+        encoding_chunk() : begin(0), end(0), errorCode(LIBSTRINGS_OK) {}
+
+        size_t begin;
+        size_t end;
+        string_arena arena;
+
+        unsigned int errorCode;
+        string errorMessage;
+    };
+
+    //Strings that have a verbatim form already in the target encoding are replaced by it rather than being encoded.
+    void encode_chunk(vector<string_ref>& strings, const vector<string_ref>& verbatim, encoding_chunk& chunk, const string& encoding) {
+        const codepage * cp = codepage::get(encoding);
+        try {
+            for (size_t i=chunk.begin; i < chunk.end; i++) {
+                if (verbatim[i].data != NULL) {
+                    strings[i] = verbatim[i];
+                    continue;
+                }
+
+                //The built-in codepages encode straight into the arena, without a temporary copy.
+                if (cp != NULL) {
+                    char * dest = chunk.arena.reserve(strings[i].length);
+                    size_t length;
+                    if (!cp->encode(strings[i].data, strings[i].length, dest, length))
+                        throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + string(strings[i].data, strings[i].length) + "\" cannot be encoded in " + encoding + ".");
+                    strings[i] = string_ref(chunk.arena.commit(length), length);
+                    continue;
+                }
+
+                const string str = FromUTF8(string(strings[i].data, strings[i].length), encoding);
+                strings[i] = string_ref(chunk.arena.store(str.data(), str.length()), str.length());
+            }
+        } catch (error& e) {
+            chunk.errorCode = e.code();
+            chunk.errorMessage = e.what();
+        } catch (bad_alloc& e) {
+            chunk.errorCode = LIBSTRINGS_ERROR_NO_MEM;
+            chunk.errorMessage = e.what();
+        } catch (exception& e) {
+            //Nothing may escape a worker thread, or the program would terminate.
+            chunk.errorCode = LIBSTRINGS_ERROR_FILE_WRITE_FAIL;
+            chunk.errorMessage = e.what();
+        } catch (...) {
+            chunk.errorCode = LIBSTRINGS_ERROR_FILE_WRITE_FAIL;
+            chunk.errorMessage = "An unknown error occurred while encoding strings in " + encoding + ".";
+        }
+    }
+
+    /* A set of strings held as indices into a list of them, using open
+       addressing with linear probing. It is sized up front for the most
+       strings it will hold, so that adding strings doesn't allocate. */
+    class string_table {
+    public:
+        string_table() : _mask(0) {}
+
+        //Makes room for the given number of strings, which must not be exceeded.
+        void reserve(const size_t count) {
+            size_t capacity = 16;
+            while (capacity < count * 2)
+                capacity *= 2;
+            _slots.assign(capacity, 0);
+            _mask = capacity - 1;
+        }
+
+        //Returns the index of the string in the list that is equal to the given string, or adds the given string's index and returns that.
+        uint32_t find_or_add(const vector<string_ref>& strings, const string_ref& str, const uint32_t index) {
+            for (size_t i = hash_value(str) & _mask;; i = (i + 1) & _mask) {
+                if (_slots[i] == 0) {
+                    _slots[i] = index + 1;
+                    return index;
+                }
+                if (strings[_slots[i] - 1] == str)
+                    return _slots[i] - 1;
+            }
+        }
+    private:
+        vector<uint32_t> _slots;  //Indices plus one, so that zero marks an empty slot.
+        size_t _mask;
+    };
+
+    /* The unique strings of the entries being saved, in the order they were
+       first added, which can then be encoded for saving. */
+    class unique_strings {
+    public:
+        unique_strings(const size_t count, const string& encoding, const string& fallbackEncoding) :
+            _encoding(encoding),
+            _toUTF8(boost::iequals("UTF-8", encoding)),
+            _toFallback(!_toUTF8 && boost::iequals(fallbackEncoding, encoding)) {
+            _strings.reserve(count);
+            _verbatim.reserve(count);
+            _indices.reserve(count);
+            if (_toFallback)
+                _rawIndices.reserve(count);
+        }
+
+        //Returns the index of the given decoded entry's string, adding it if it hasn't been added already.
+        uint32_t add(const string_entry& entry) {
+            //Strings that were transcoded from the fallback encoding when decoded can be saved in it as they were read, so are deduplicated on those bytes.
+            if (_toFallback && entry.raw() != NULL && entry.raw() != entry.c_str()) {
+                const string_ref raw(entry.raw(), entry.raw_length());
+                return insert(_rawIndices, raw, raw);
+            }
+            return insert(_indices, string_ref(entry.c_str(), entry.length()), string_ref(NULL, 0));
+        }
+
+        /* Adds the raw bytes of an entry that hasn't been decoded, if they can
+           be saved as they are, outputting the string's index. Returns false
+           if the entry must be decoded and added instead. Only raw bytes that
+           aren't valid UTF-8 are in the fallback encoding, as valid UTF-8 is
+           kept as it is when decoded, and so still needs encoding. */
+        bool add_raw(const string_entry& entry, uint32_t& index) {
+            if (!_toFallback || entry.is_decoded() || entry.raw() == NULL || IsValidUTF8(entry.raw(), entry.raw_length()))
+                return false;
+
+            const string_ref raw(entry.raw(), entry.raw_length());
+            index = insert(_rawIndices, raw, raw);
+            return true;
+        }
+
+        /* Replaces the strings with views of their encoded forms, which last
+           as long as this object. Threads each encode a run of the strings,
+           so their order is unchanged. Strings are held in UTF-8 unless they
+           are saved as they were read, so only need encoding for other
+           encodings. */
+        void encode(unsigned int threads) {
+            if (_toUTF8)
+                return;
+
+            if (threads == 0)
+                threads = boost::thread::hardware_concurrency();
+            const size_t chunkCount = max((size_t)1, min((size_t)threads, _strings.size() / minStringsPerThread));
+
+            _chunks.reset(new encoding_chunk[chunkCount]);
+            for (size_t i=0; i < chunkCount; i++) {
+                _chunks[i].begin = _strings.size() * i / chunkCount;
+                _chunks[i].end = _strings.size() * (i + 1) / chunkCount;
+            }
+
+            boost::thread_group group;
+            size_t started = 1;
+            try {
+                for (; started < chunkCount; started++)
+                    group.create_thread(boost::bind(&encode_chunk, boost::ref(_strings), boost::cref(_verbatim), boost::ref(_chunks[started]), boost::cref(_encoding)));
+            } catch (boost::thread_resource_error&) {
+                //Encode the chunks that didn't get a thread on this one.
+            }
+            encode_chunk(_strings, _verbatim, _chunks[0], _encoding);
+            for (size_t i=started; i < chunkCount; i++)
+                encode_chunk(_strings, _verbatim, _chunks[i], _encoding);
+            group.join_all();
+
+            for (size_t i=0; i < chunkCount; i++) {
+                if (_chunks[i].errorCode != LIBSTRINGS_OK)
+                    throw error(_chunks[i].errorCode, _chunks[i].errorMessage);
+            }
+        }
+
+        const vector<string_ref>& strings() const {
+            return _strings;
+        }
+    private:
+        uint32_t insert(string_table& indices, const string_ref& str, const string_ref& verbatim) {
+            const uint32_t index = indices.find_or_add(_strings, str, _strings.size());
+            if (index == _strings.size()) {
+                _strings.push_back(str);
+                _verbatim.push_back(verbatim);
+            }
+            return index;
+        }
+
+        const string _encoding;
+        const bool _toUTF8;
+        const bool _toFallback;
+        string_table _indices;
+        string_table _rawIndices;  //Strings that are saved as they were read, keyed on those bytes.
+        vector<string_ref> _strings;
+        vector<string_ref> _verbatim;  //The raw bytes of strings that haven't changed since they were read in the target encoding.
+        boost::scoped_array<encoding_chunk> _chunks;
+    };
+
+    //Copies a string into a data block, prefixing it with its length including the terminator for DLSTRINGS and ILSTRINGS files, and returns the position after it.
+    char * copy_string(char * pos, const string_ref& str, const bool isDotStrings) {
+        if (!isDotStrings) {
+            const uint32_t size = str.length + 1;
+            memcpy(pos, &size, sizeof(uint32_t));
+            pos += sizeof(uint32_t);
+        }
+        memcpy(pos, str.data, str.length);
+        pos += str.length;
+        *pos++ = '\0';
+        return pos;
+    }
+
+    //Orders strings by their reversed bytes, so that each string comes right before those it is a suffix of.
+    class reversed_less {
+    public:
+        reversed_less(const vector<string_ref>& strings) : _strings(strings) {}
+
+        bool operator () (const uint32_t a, const uint32_t b) const {
+            const string_ref& x = _strings[a];
+            const string_ref& y = _strings[b];
+            for (size_t i=1; i <= x.length && i <= y.length; i++) {
+                const unsigned char cx = x.data[x.length - i];
+                const unsigned char cy = y.data[y.length - i];
+                if (cx != cy)
+                    return cx < cy;
+            }
+            return x.length < y.length;
+        }
+    private:
+        const vector<string_ref>& _strings;
+    };
+
+    bool is_suffix(const string_ref& suffix, const string_ref& str) {
+        return suffix.length <= str.length && memcmp(suffix.data, str.data + str.length - suffix.length, suffix.length) == 0;
+    }
+
+    /* Finds the string that each null-terminated string can share the tail
+       of, as the longest string that it is a suffix of, or itself if there
+       isn't one. When sorted by their reversed bytes, any string that ends
+       another is a suffix of the string after it, so one pass from the end
+       finds every host. */
+    void merge_tails(const vector<string_ref>& strings, vector<uint32_t>& hosts) {
+        vector<uint32_t> order(strings.size());
+        for (size_t i=0; i < order.size(); i++)
+            order[i] = i;
+        sort(order.begin(), order.end(), reversed_less(strings));
+
+        for (size_t i=order.size(); i > 0; i--) {
+            const uint32_t current = order[i - 1];
+            if (i < order.size() && is_suffix(strings[current], strings[order[i]]))
+                hosts[current] = hosts[order[i]];
+            else
+                hosts[current] = current;
+        }
+    }
+
+    /* The data block formats. Each finds the string starting at the given
+       offset into the data block, returning false if there isn't a complete
+       string there, and gives the offset of the string after it. The parser
+       is specialised on the format at compile time. */
+
+    //STRINGS files hold null-terminated strings.
+    struct null_terminated_format {
+        static bool find(const uint8_t * block, const size_t blockSize, const size_t pos, const char *& str, size_t& length) {
+            if (pos >= blockSize)
+                return false;
+
+            str = (const char*)(block + pos);
+            const char * nptr = (const char*)memchr(str, '\0', blockSize - pos);
+            if (nptr == NULL)
+                return false;
+
+            length = nptr - str;
+            return true;
+        }
+
+        static size_t next(const size_t pos, const size_t length) {
+            return pos + length + 1;
+        }
+
+        //Whether find() gives the same result given only the first bytes of the block as it would given all of them.
+        static bool decided(const uint8_t * block, const size_t available, const size_t blockSize, const size_t pos) {
+            return available == blockSize || (pos < available && memchr(block + pos, '\0', available - pos) != NULL);
+        }
+    };
+
+    //DLSTRINGS and ILSTRINGS files prefix each string with its length, including the null terminator.
+    struct length_prefixed_format {
+        static bool find(const uint8_t * block, const size_t blockSize, const size_t pos, const char *& str, size_t& length) {
+            if (pos >= blockSize || blockSize - pos < sizeof(uint32_t))
+                return false;
+
+            //Strings aren't aligned, so the prefix may not be either.
+            uint32_t size;
+            memcpy(&size, block + pos, sizeof(uint32_t));
+            const size_t strPos = pos + sizeof(uint32_t);
+
+            //Trust the prefix if it fits in the file and ends in a null terminator, otherwise fall back to looking for one.
+            if (size > 0 && size <= blockSize - strPos && block[strPos + size - 1] == '\0') {
+                str = (const char*)(block + strPos);
+                length = size - 1;
+                return true;
+            }
+            return null_terminated_format::find(block, blockSize, strPos, str, length);
+        }
+
+        static size_t next(const size_t pos, const size_t length) {
+            return pos + sizeof(uint32_t) + length + 1;
+        }
+
+        static bool decided(const uint8_t * block, const size_t available, const size_t blockSize, const size_t pos) {
+            if (available == blockSize)
+                return true;
+            if (pos >= available || available - pos < sizeof(uint32_t))
+                return false;
+
+            //A prefix that fits in the block can only be trusted or not once the byte it ends at is available.
+            uint32_t size;
+            memcpy(&size, block + pos, sizeof(uint32_t));
+            const size_t strPos = pos + sizeof(uint32_t);
+            if (size > 0 && size <= blockSize - strPos) {
+                if (size > available - strPos)
+                    return false;
+                if (block[strPos + size - 1] == '\0')
+                    return true;
+            }
+            return null_terminated_format::decided(block, available, blockSize, strPos);
+        }
+    };
+
+    //Reads entries from a strings file's directory, finding their strings in the data block.
+    template <class Format>
+    class directory_reader {
+    public:
+        //The name is the file's quoted path, or another description of where its contents came from, for use in error messages.
+        directory_reader(const uint8_t * fileContent, const size_t fileSize, const size_t startOfData, const string& name) :
+            _directory(fileContent + sizeof(uint32_t) * 2),
+            _block(fileContent + startOfData),
+            _blockSize(fileSize - startOfData),
+            _name(name) {}
+
+        string_entry read(const size_t index, uint32_t& id, uint32_t& offset) const {
+            const uint8_t * entry = _directory + sizeof(uint32_t) * 2 * index;
+            id = *reinterpret_cast<const uint32_t*>(entry);
+            offset = *reinterpret_cast<const uint32_t*>(entry + sizeof(uint32_t));
+
+            const char * str;
+            size_t length;
+            if (!Format::find(_block, _blockSize, offset, str, length))
+                throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of " + _name + ".");
+
+            return string_entry(str, length, false, offset);
+        }
+
+        //Reads and decodes a chunk. Strings that can't be decoded are left for their first use to report.
+        void read_chunk(directory_chunk& chunk, const string& fallbackEncoding) const {
+            try {
+                chunk.entries.reserve(chunk.end - chunk.begin);
+                chunk.offsets.reserve(chunk.end - chunk.begin);
+                for (size_t i=chunk.begin; i < chunk.end; i++) {
+                    uint32_t id, offset;
+                    string_entry entry = read(i, id, offset);
+                    try {
+                        entry.decode(fallbackEncoding, chunk.arena, chunk.collectStats ? &chunk.stats : NULL);
+                    } catch (error& e) {}
+                    chunk.entries.push_back(pair<uint32_t, string_entry>(id, entry));
+                    chunk.offsets.push_back(offset);
+                }
+            } catch (error& e) {
+                chunk.errorCode = e.code();
+                chunk.errorMessage = e.what();
+            } catch (bad_alloc& e) {
+                chunk.errorCode = LIBSTRINGS_ERROR_NO_MEM;
+                chunk.errorMessage = e.what();
+            } catch (exception& e) {
+                //Nothing may escape a worker thread, or the program would terminate.
+                chunk.errorCode = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+                chunk.errorMessage = e.what();
+            } catch (...) {
+                chunk.errorCode = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+                chunk.errorMessage = "An unknown error occurred while reading " + _name + ".";
+            }
+        }
+    private:
+        const uint8_t * _directory;
+        const uint8_t * _block;
+        const size_t _blockSize;
+        const string& _name;
+    };
+}
+
+_strings_handle_int::_strings_handle_int(const string& path, const string& fallbackEncoding, const bool mapFile, unsigned int threads) :
+    sourcePath(path),
+    fallbackEncoding(fallbackEncoding),
+    startOfData(0),
+    sourceSize(0),
+    sourceWriteTime(0),
+    concurrent(false),
+    stats(),
+    extBufferSize(0),
+    unrefScanned(false) {
 
     //Check extension.
     const string ext = fs::path(path).extension().string();
@@ -56,113 +641,157 @@ _strings_handle_int::_strings_handle_int(const string& path, const string& fallb
 
     //If the file already exists, parse it.
     if (fs::exists(path)) {
-        libstrings::ifstream in(fs::path(path), ios::binary);
-        in.exceptions(ios::failbit | ios::badbit | ios::eofbit);  //Causes ifstream::failure to be thrown if problem is encountered.
-
         /*The data for each string is stored in two separate places.
         The directory holds all the IDs and offsets, and the data block
         holds all the strings at their offsets.
         Loop through the directory and for each entry, record the ID,
         look up the string using the offset and store that.
-        Quickest to read whole file into memory, parse it from there
-        then free that memory. Jumping around inside a file stream is
-        a bit slower. */
-        uint8_t * fileContent;
-        uint32_t fileSize;
-
-        //Get the file's length.
-        in.seekg(0, ios::end);
-        fileSize = in.tellg();
-
-        //Allocate memory.
-        try {
-            fileContent = new uint8_t[fileSize];
-        } catch (bad_alloc& e) {
-            throw error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+        The whole file is held in memory (or mapped into it) for the
+        lifetime of the handle, so that strings can be stored as views
+        into it rather than copied. Strings are only checked and
+        transcoded when they are first used. */
+        {
+            LIBSTRINGS_TRACE("read");
+            stats_timer timer(Stats(), &st_stats::readTime);
+            if (mapFile)
+                source.map(path);
+            else
+                source.read(path);
         }
 
-        //Read whole file into memory.
-        in.seekg(0, ios::beg);
-        in.read((char*)fileContent, fileSize);
-
-        in.close();
-
-        //Get number of directory entries.
-        uint32_t dirCount = *reinterpret_cast<uint32_t*>(fileContent);
+        Parse("\"" + path + "\"", threads);
+        RecordSource((const char*)source.data(), startOfData);
+    }
+}
 
-        uint32_t pos = sizeof(uint32_t) * 2;
-        uint32_t startOfData = sizeof(uint32_t) * 2 * (dirCount + 1);
-        boost::unordered_set<uint32_t> offsets;
-        while (pos < startOfData) {
-            string str;
-            uint32_t id = *reinterpret_cast<uint32_t*>(fileContent + pos);
-            uint32_t offset = *reinterpret_cast<uint32_t*>(fileContent + pos + sizeof(uint32_t));
-            uint32_t strPos = startOfData + offset;
-            if (!isDotStrings)
-                strPos += sizeof(uint32_t);
+_strings_handle_int::_strings_handle_int(const uint8_t * buffer, const size_t size, const bool isDotStrings, const string& fallbackEncoding, const bool borrow, unsigned int threads) :
+    fallbackEncoding(fallbackEncoding),
+    isDotStrings(isDotStrings),
+    startOfData(0),
+    sourceSize(0),
+    sourceWriteTime(0),
+    concurrent(false),
+    stats(),
+    extBufferSize(0),
+    unrefScanned(false) {
 
-            //Find position of null pointer.
-            char * nptr = strchr((char*)(fileContent + strPos), '\0');
-            if (nptr == NULL)
-                throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, "Could not read contents of \"" + path + "\".");
+    {
+        LIBSTRINGS_TRACE("read");
+        stats_timer timer(Stats(), &st_stats::readTime);
+        if (borrow)
+            source.borrow(buffer, size);
+        else
+            source.assign(buffer, size);
+    }
 
-            //Now set string, transcoding if necessary.
-            str = ToUTF8(string((char*)(fileContent + strPos), nptr - (char*)(fileContent + strPos)), fallbackEncoding);
+    Parse("the given buffer", threads);
+}
 
-            data.insert(pair<uint32_t, string>(id, str));
-            offsets.insert(offset);
+_strings_handle_int::_strings_handle_int(_strings_handle_int& other) :
+    data(other.data),
+    sourcePath(other.sourcePath),
+    fallbackEncoding(other.fallbackEncoding),
+    isDotStrings(other.isDotStrings),
+    startOfData(0),
+    sourceSize(0),
+    sourceWriteTime(0),
+    concurrent(false),
+    stats(),
+    extBufferSize(0),
+    unrefScanned(true) {
 
-            pos += 2 * sizeof(uint32_t);
-        }
+    //Passing an empty range copies every string, leaving none pointing into the other handle's source or arena.
+    for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it)
+        it->second.move_to(arena, NULL, NULL, false);
+}
 
-        //Now before we delete the contents, let's look for unreferenced strings.
-        pos = startOfData;
-        boost::unordered_set<uint32_t>::iterator endIt = offsets.end();
-        while (pos < fileSize) {
-            stringstream out;
-            string str;
+//Parse the file held in the source buffer.
+void _strings_handle_int::Parse(const std::string& name, unsigned int threads) {
+    LIBSTRINGS_TRACE("parse directory");
+    stats_timer timer(Stats(), &st_stats::parseTime);
+    const uint8_t * fileContent = source.data();
+    const size_t fileSize = source.size();
 
-            if (isDotStrings)
-                out << fileContent + pos;
-            else
-                out << fileContent + pos + sizeof(uint32_t);
-            str = out.str();
+    if (fileSize < sizeof(uint32_t) * 2)
+        throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, name + " is not a valid strings file.");
 
-            if (offsets.find(pos - startOfData) == endIt)
-                unrefStrings.emplace(ToUTF8(str, fallbackEncoding));
+    //Get number of directory entries.
+    uint32_t dirCount = *reinterpret_cast<const uint32_t*>(fileContent);
 
-            pos += str.length() + 1;
-            if (!isDotStrings)
-                pos += sizeof(uint32_t);
-        }
+    startOfData = sizeof(uint32_t) * 2 * ((size_t)dirCount + 1);
+    if (startOfData > fileSize)
+        throw error(LIBSTRINGS_ERROR_FILE_READ_FAIL, name + " is not a valid strings file.");
 
-        delete [] fileContent;
+    sourceSize = fileSize;
+    if (Stats() != NULL) {
+        stats.bytesRead += fileSize;
+        stats.entries += dirCount;
     }
+
+    if (isDotStrings)
+        ReadDirectory<null_terminated_format>(dirCount, name, threads);
+    else
+        ReadDirectory<length_prefixed_format>(dirCount, name, threads);
 }
 
-_strings_handle_int::~_strings_handle_int() {
-    if (extString != NULL)
-        delete [] extString;
+template <class Format>
+void _strings_handle_int::ReadDirectory(const uint32_t dirCount, const std::string& name, unsigned int threads) {
+    const directory_reader<Format> reader(source.data(), source.size(), startOfData, name);
 
-    if (extStringDataArr != NULL) {
-        for (size_t i=0; i < extStringDataArrSize; i++)
-            delete [] extStringDataArr[i].data;
-        delete [] extStringDataArr;
-    }
+    //Only split the directory between threads if each gets a worthwhile amount of it.
+    if (threads == 0)
+        threads = boost::thread::hardware_concurrency();
+    const size_t chunkCount = min((size_t)threads, (size_t)dirCount / minEntriesPerThread);
+
+    referencedOffsets.reserve(dirCount);
+    data.reserve(dirCount);
+    if (chunkCount <= 1) {
+        for (uint32_t i=0; i < dirCount; i++) {
+            uint32_t id, offset;
+            //Strings will be transcoded if necessary when first used.
+            string_entry entry = reader.read(i, id, offset);
+            data.insert(id, entry);
+            referencedOffsets.push_back(offset);
+        }
+    } else {
+        //Read and decode chunks in parallel, then merge them in directory order so that the result is the same as when reading serially.
+        boost::scoped_array<directory_chunk> chunks(new directory_chunk[chunkCount]);
+        for (size_t i=0; i < chunkCount; i++) {
+            chunks[i].begin = dirCount * i / chunkCount;
+            chunks[i].end = dirCount * (i + 1) / chunkCount;
+            chunks[i].collectStats = Stats() != NULL;
+        }
+
+        boost::thread_group group;
+        size_t started = 1;
+        try {
+            for (; started < chunkCount; started++)
+                group.create_thread(boost::bind(&directory_reader<Format>::read_chunk, &reader, boost::ref(chunks[started]), boost::cref(fallbackEncoding)));
+        } catch (boost::thread_resource_error&) {
+            //Read the chunks that didn't get a thread on this one.
+        }
+        reader.read_chunk(chunks[0], fallbackEncoding);
+        for (size_t i=started; i < chunkCount; i++)
+            reader.read_chunk(chunks[i], fallbackEncoding);
+        group.join_all();
 
-    if (extStringArr != NULL) {
-        for (size_t i=0; i < extStringArrSize; i++)
-            delete [] extStringArr[i];
-        delete [] extStringArr;
+        for (size_t i=0; i < chunkCount; i++) {
+            if (chunks[i].errorCode != LIBSTRINGS_OK)
+                throw error(chunks[i].errorCode, chunks[i].errorMessage);
+            for (vector< pair<uint32_t, string_entry> >::const_iterator it=chunks[i].entries.begin(), endIt=chunks[i].entries.end(); it != endIt; ++it)
+                data.insert(it->first, it->second);
+            referencedOffsets.insert(referencedOffsets.end(), chunks[i].offsets.begin(), chunks[i].offsets.end());
+            arena.splice(chunks[i].arena);
+            if (chunks[i].collectStats)
+                add_stats(stats, chunks[i].stats);
+        }
     }
 }
 
+_strings_handle_int::~_strings_handle_int() {}
+
 //Save file data to given path.
-void _strings_handle_int::Save(const std::string& path, const std::string& encoding) {
-    //Save everything in memory to the file.
-    string directory;
-    string strData;
-    boost::unordered_map<string, uint32_t> hashmap;
+void _strings_handle_int::Save(const std::string& path, const std::string& encoding, unsigned int threads, const bool mergeTails, const cancel_flag * cancel) {
     bool isDotStrings;
 
     //Check extension.
@@ -174,51 +803,464 @@ void _strings_handle_int::Save(const std::string& path, const std::string& encod
     else
         throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "File passed does not have a valid extension.");
 
-    //Output to buffers.
-    for (boost::unordered_map<uint32_t, string>::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
-
-        /* Search for this pair's string in the hashset.
-            If present, use the offset in the hashmap for the directory entry's offset,
-            and don't add the string again.
-            Otherwise, add as normal. */
-
-        boost::unordered_map<string, uint32_t>::iterator searchIt = hashmap.find(it->second);
-        if (searchIt != hashmap.end()) {
-            //Write directory data to its buffer.
-            directory   += string((char*)&(it->first), sizeof(uint32_t))
-                        +  string((char*)&(searchIt->second), sizeof(uint32_t));
-        } else {
-            uint32_t len = strData.length();
-
-            //Write directory data to its buffer.
-            directory   += string((char*)&(it->first), sizeof(uint32_t))
-                        +  string((char*)&len, sizeof(uint32_t));
-
-            //Write string data to its buffer, and increment the dataSize.
-            string str = it->second + '\0';
-            if (!isDotStrings) {
-                uint32_t size = str.length();
-                str = string((char*)&size, sizeof(uint32_t)) + str;
+    //Overwriting a mapped file would pull the strings out from under the handle.
+    const bool overwritesSource = fs::exists(path) && fs::equivalent(path, sourcePath);
+    if (source.is_mapped() && overwritesSource)
+        Detach();
+
+    boost::scoped_array<char> buffer;
+    const size_t fileSize = Layout(isDotStrings, encoding, threads, mergeTails, buffer);
+
+    if (cancel != NULL && cancel->is_set())
+        throw error(LIBSTRINGS_ERROR_CANCELLED, "The save to \"" + path + "\" was cancelled.");
+
+    //Now write out everything.
+    try {
+        LIBSTRINGS_TRACE("write");
+        stats_timer timer(Stats(), &st_stats::writeTime);
+        boost::iostreams::file_descriptor_sink out(fs::path(path), ios::binary | ios::trunc);
+        out.write(buffer.get(), fileSize);
+        out.close();
+    } catch (ios_base::failure& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
+    }
+    if (Stats() != NULL)
+        stats.bytesWritten += fileSize;
+
+    //If the file the handle was opened from was saved over, record where its strings now are so that it can be patched.
+    if (overwritesSource || fs::equivalent(path, sourcePath)) {
+        FindUnreferenced();
+        startOfData = sizeof(uint32_t) * 2 * (data.size() + 1);
+        const char * directory = buffer.get() + sizeof(uint32_t) * 2;
+        for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it, directory += sizeof(uint32_t) * 2) {
+            uint32_t offset;
+            memcpy(&offset, directory + sizeof(uint32_t), sizeof(uint32_t));
+            it->second.set_offset(offset);
+        }
+        sourceSize = fileSize;
+        RecordSource(buffer.get(), startOfData);
+    }
+
+    Compact();
+}
+
+//Save file data to a buffer held by the handle.
+void _strings_handle_int::SaveToMemory(const bool dotStrings, const std::string& encoding) {
+    boost::scoped_array<char> buffer;
+    const size_t size = Layout(dotStrings, encoding, 1, false, buffer);
+    extBuffer.swap(buffer);
+    extBufferSize = size;
+}
+
+//Lay out file data in the given format, outputting the file's contents and returning its size.
+size_t _strings_handle_int::Layout(const bool dotStrings, const std::string& encoding, unsigned int threads, const bool mergeTails, boost::scoped_array<char>& buffer) {
+    /* The file is laid out in passes. The first finds the unique strings,
+       and which of them each directory entry uses. The unique strings are
+       then encoded, and once their encoded lengths are known, any that can
+       share the tails of others are found and they are given their offsets.
+       Finally, everything is copied into a buffer of exactly the file's
+       size, so that it can be written out in one go. */
+    vector<uint32_t> directory;  //Pairs of IDs and unique string indices, then of IDs and offsets.
+    unique_strings uniqueStrings(data.size(), encoding, fallbackEncoding);
+    {
+        LIBSTRINGS_TRACE("dedupe");
+        stats_timer timer(Stats(), &st_stats::dedupeTime);
+        directory.reserve(data.size() * 2);
+        for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+            directory.push_back(it->first);
+            //Strings that haven't been read since they were loaded are only decoded if they can't be saved as they are.
+            uint32_t index;
+            if (!uniqueStrings.add_raw(it->second, index)) {
+                it->second.decode(fallbackEncoding, arena, Stats());
+                index = uniqueStrings.add(it->second);
             }
-            strData += FromUTF8(str, encoding);
+            directory.push_back(index);
+        }
+    }
+
+    {
+        LIBSTRINGS_TRACE("encode");
+        stats_timer timer(Stats(), &st_stats::encodeTime);
+        uniqueStrings.encode(threads);
+    }
+    const vector<string_ref>& uniques = uniqueStrings.strings();
+    if (Stats() != NULL) {
+        stats.stringsSaved += data.size();
+        stats.uniqueStringsSaved += uniques.size();
+    }
 
-            //Add to hashset to prevent it being written again.
-            hashmap.insert(pair<string, uint32_t>(it->second, len));
+    LIBSTRINGS_TRACE("layout");
+    stats_timer timer(Stats(), &st_stats::layoutTime);
+
+    //In STRINGS files, strings that end others can be stored as part of them.
+    vector<uint32_t> hosts(uniques.size());
+    if (mergeTails && dotStrings)
+        merge_tails(uniques, hosts);
+    else {
+        for (size_t i=0; i < hosts.size(); i++)
+            hosts[i] = i;
+    }
+
+    //Each string is null-terminated, and in DLSTRINGS and ILSTRINGS files is prefixed by its length including the terminator.
+    const size_t prefixSize = dotStrings ? 0 : sizeof(uint32_t);
+    vector<uint32_t> offsets(uniques.size());
+    uint64_t dataSize = 0;
+    for (size_t i=0; i < uniques.size(); i++) {
+        if (hosts[i] != i)
+            continue;
+        offsets[i] = dataSize;
+        dataSize += prefixSize + uniques[i].length + 1;
+        if (dataSize > 0xFFFFFFFF)
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "The strings are too large to be saved.");
+    }
+    for (size_t i=0; i < uniques.size(); i++) {
+        if (hosts[i] != i)
+            offsets[i] = offsets[hosts[i]] + uniques[hosts[i]].length - uniques[i].length;
+    }
+    for (size_t i=1; i < directory.size(); i += 2)
+        directory[i] = offsets[directory[i]];
+
+    const uint32_t header[] = { (uint32_t)data.size(), (uint32_t)dataSize };
+    const size_t directorySize = directory.size() * sizeof(uint32_t);
+    const size_t fileSize = sizeof(header) + directorySize + dataSize;
+    buffer.reset(new char[fileSize]);
+
+    memcpy(buffer.get(), header, sizeof(header));
+    if (!directory.empty())
+        memcpy(buffer.get() + sizeof(header), &directory[0], directorySize);
+    char * pos = buffer.get() + sizeof(header) + directorySize;
+    for (size_t i=0; i < uniques.size(); i++) {
+        if (hosts[i] != i)
+            continue;
+        pos = copy_string(pos, uniques[i], dotStrings);
+    }
+
+    return fileSize;
+}
+
+//Save changes to the file the handle was opened from in place.
+void _strings_handle_int::SavePatch(const std::string& encoding) {
+    /* The directory is rewritten in place, and new and changed strings are
+       appended to the end of the file, leaving the rest of its strings where
+       they are. The file is rewritten in full if it isn't as the handle last
+       left it, or if the directory would shrink, as that would leave a gap
+       before the data block. */
+    const size_t newStartOfData = sizeof(uint32_t) * 2 * (data.size() + 1);
+    if (startOfData == 0 || newStartOfData < startOfData || newStartOfData > sourceSize || !SourceUnchanged()) {
+        Save(sourcePath, encoding);
+        return;
+    }
+
+    //The rest of a string cut in two by the grown directory would be read as another string, so the file must be rewritten instead.
+    if (newStartOfData > startOfData && (isDotStrings ? SplitsString<null_terminated_format>(newStartOfData) : SplitsString<length_prefixed_format>(newStartOfData))) {
+        Save(sourcePath, encoding);
+        return;
+    }
+
+    //If the directory grows, it overwrites the strings at the start of the data block, which must be copied out of a mapped source first.
+    FindUnreferenced();
+    if (source.is_mapped()) {
+        const char * begin = (const char*)source.data() + startOfData;
+        const char * end = (const char*)source.data() + min(newStartOfData, source.size());
+        for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it)
+            it->second.move_to(arena, begin, end, true);
+        for (vector<string_entry>::iterator it=unrefStrings.begin(), endIt=unrefStrings.end(); it != endIt; ++it)
+            it->move_to(arena, begin, end, true);
+    }
+
+    //Entries are given positions relative to the start of the file, then offsets once all positions are known. Overwritten strings are appended with new and changed ones.
+    vector<uint32_t> directory;
+    vector<bool> appended;
+    unique_strings uniqueStrings(data.size(), encoding, fallbackEncoding);
+    {
+        LIBSTRINGS_TRACE("dedupe");
+        stats_timer timer(Stats(), &st_stats::dedupeTime);
+        directory.reserve(data.size() * 2);
+        appended.reserve(data.size());
+        for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+            directory.push_back(it->first);
+            const uint64_t position = (uint64_t)startOfData + it->second.offset();
+            if (it->second.offset() == string_entry::noOffset || position < newStartOfData) {
+                uint32_t index;
+                if (!uniqueStrings.add_raw(it->second, index)) {
+                    it->second.decode(fallbackEncoding, arena, Stats());
+                    index = uniqueStrings.add(it->second);
+                }
+                directory.push_back(index);
+                appended.push_back(true);
+            } else {
+                directory.push_back(position - newStartOfData);
+                appended.push_back(false);
+            }
         }
+    }
 
+    {
+        LIBSTRINGS_TRACE("encode");
+        stats_timer timer(Stats(), &st_stats::encodeTime);
+        uniqueStrings.encode(1);
+    }
+    const vector<string_ref>& uniques = uniqueStrings.strings();
+    if (Stats() != NULL) {
+        stats.stringsSaved += data.size();
+        stats.uniqueStringsSaved += uniques.size();
+    }
 
+    const size_t prefixSize = isDotStrings ? 0 : sizeof(uint32_t);
+    vector<uint32_t> offsets;
+    offsets.reserve(uniques.size());
+    uint64_t fileSize = sourceSize;
+    for (vector<string_ref>::const_iterator it=uniques.begin(), endIt=uniques.end(); it != endIt; ++it) {
+        offsets.push_back(fileSize - newStartOfData);
+        fileSize += prefixSize + it->length + 1;
+        if (fileSize - newStartOfData > 0xFFFFFFFF)
+            throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "The strings are too large to be saved to \"" + sourcePath + "\".");
+    }
+    for (size_t i=0; i < appended.size(); i++) {
+        if (appended[i])
+            directory[2 * i + 1] = offsets[directory[2 * i + 1]];
     }
-    uint32_t count = data.size();
-    uint32_t dataSize = strData.length();
 
-    //Now write out everything.
-    libstrings::ofstream out(fs::path(path), ios::binary | ios::trunc);
-    if (!out.good())
-        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + path + "\".");
-    out.write((char*)&count, sizeof(uint32_t));
-    out.write((char*)&dataSize, sizeof(uint32_t));
-    out.write((char*)directory.data(), directory.length());
-    out.write((char*)strData.data(), strData.length());
+    const uint32_t header[] = { (uint32_t)data.size(), (uint32_t)(fileSize - newStartOfData) };
+    const size_t directorySize = directory.size() * sizeof(uint32_t);
+    boost::scoped_array<char> head(new char[sizeof(header) + directorySize]);
+    boost::scoped_array<char> tail(new char[fileSize - sourceSize]);
+
+    {
+        LIBSTRINGS_TRACE("layout");
+        stats_timer timer(Stats(), &st_stats::layoutTime);
+        memcpy(head.get(), header, sizeof(header));
+        if (!directory.empty())
+            memcpy(head.get() + sizeof(header), &directory[0], directorySize);
+        char * pos = tail.get();
+        for (vector<string_ref>::const_iterator it=uniques.begin(), endIt=uniques.end(); it != endIt; ++it)
+            pos = copy_string(pos, *it, isDotStrings);
+    }
+
+    //Append the strings before rewriting the directory that refers to them.
+    try {
+        LIBSTRINGS_TRACE("write");
+        stats_timer timer(Stats(), &st_stats::writeTime);
+        boost::iostreams::file_descriptor out(fs::path(sourcePath), ios::in | ios::out | ios::binary);
+        out.seek(sourceSize, ios::beg);
+        out.write(tail.get(), fileSize - sourceSize);
+        out.seek(0, ios::beg);
+        out.write(head.get(), sizeof(header) + directorySize);
+        out.close();
+    } catch (ios_base::failure& e) {
+        throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + sourcePath + "\".");
+    }
+    if (Stats() != NULL)
+        stats.bytesWritten += fileSize - sourceSize + sizeof(header) + directorySize;
+
+    size_t i = 1;
+    for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it, i += 2)
+        it->second.set_offset(directory[i]);
+    startOfData = newStartOfData;
+    sourceSize = fileSize;
+    RecordSource(head.get(), sizeof(header) + directorySize);
+
+    Compact();
+}
+
+//Record the state of the file the handle was opened from, given the header and directory it now has.
+void _strings_handle_int::RecordSource(const char * head, const size_t size) {
+    boost::system::error_code ec;
+    sourceWriteTime = fs::last_write_time(sourcePath, ec);
+    sourceHead.assign(head, head + size);
+}
+
+//Check that the file the handle was opened from is as the handle last read or wrote it. Only the parts that patching depends on are compared.
+bool _strings_handle_int::SourceUnchanged() const {
+    boost::system::error_code ec;
+    if (fs::file_size(sourcePath, ec) != sourceSize || ec)
+        return false;
+    if (fs::last_write_time(sourcePath, ec) != sourceWriteTime || ec)
+        return false;
 
-    out.close();
+    try {
+        boost::iostreams::file_descriptor_source in(fs::path(sourcePath), ios::binary);
+        vector<char> head(sourceHead.size());
+        size_t count = 0;
+        while (count < head.size()) {
+            const streamsize read = in.read(&head[count], head.size() - count);
+            if (read <= 0)
+                return false;
+            count += read;
+        }
+        return head == sourceHead;
+    } catch (ios_base::failure& e) {
+        return false;
+    }
+}
+
+//Decode all strings, so that reading them doesn't change the handle.
+void _strings_handle_int::DecodeAll() {
+    //Strings that can't be decoded are left as they are: decoding them again fails without changing them.
+    for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it) {
+        try {
+            it->second.decode(fallbackEncoding, arena, Stats());
+        } catch (error&) {}
+    }
+
+    FindUnreferenced();
+    for (vector<string_entry>::iterator it=unrefStrings.begin(), endIt=unrefStrings.end(); it != endIt; ++it) {
+        try {
+            it->decode(fallbackEncoding, arena, Stats());
+        } catch (error&) {}
+    }
+}
+
+//Find the strings in the source's data block that no directory entry references.
+void _strings_handle_int::FindUnreferenced() {
+    if (unrefScanned)
+        return;
+
+    if (source.size() > startOfData) {
+        LIBSTRINGS_TRACE("scan unreferenced");
+        stats_timer timer(Stats(), &st_stats::scanTime);
+        if (isDotStrings)
+            ScanDataBlock<null_terminated_format>();
+        else
+            ScanDataBlock<length_prefixed_format>();
+        if (Stats() != NULL)
+            stats.unreferencedStrings += unrefStrings.size();
+    }
+
+    vector<uint32_t>().swap(referencedOffsets);
+    unrefScanned = true;
+}
+
+template <class Format>
+void _strings_handle_int::ScanDataBlock() {
+    /* Walk the data block once, string by string, stepping through the
+       sorted referenced offsets alongside it. The strings found are views
+       into the source, like those in data. */
+    sort(referencedOffsets.begin(), referencedOffsets.end());
+
+    const uint8_t * block = source.data() + startOfData;
+    const size_t blockSize = source.size() - startOfData;
+    vector<uint32_t>::const_iterator refIt = referencedOffsets.begin(), refEndIt = referencedOffsets.end();
+    const char * str;
+    size_t length;
+    //Anything after the last complete string is ignored.
+    for (size_t pos = 0; Format::find(block, blockSize, pos, str, length); pos = Format::next(pos, length)) {
+        while (refIt != refEndIt && *refIt < pos)
+            ++refIt;
+        if (refIt == refEndIt || *refIt != pos)
+            unrefStrings.push_back(string_entry(str, length, false, pos));
+    }
+}
+
+template <class Format>
+bool _strings_handle_int::SplitsString(const size_t position) const {
+    /* Walk the file's data block from its start up to the position, which
+       must be inside it. The handle's copy of the file may no longer match
+       it, so the block is read from the file, only as far as is needed to
+       find the strings before the position. If the file can't be read, it
+       is assumed to be split. */
+    const size_t blockSize = sourceSize - startOfData;
+    const size_t end = position - startOfData;
+    vector<uint8_t> block;
+    size_t available = 0;
+    try {
+        boost::iostreams::file_descriptor_source in(fs::path(sourcePath), ios::binary);
+        in.seek(startOfData, ios::beg);
+
+        size_t pos = 0;
+        while (pos < end) {
+            while (!Format::decided(block.empty() ? NULL : &block[0], available, blockSize, pos)) {
+                block.resize(min(blockSize, max(2 * available, end + 256)));
+                while (available < block.size()) {
+                    const streamsize read = in.read((char*)&block[available], block.size() - available);
+                    if (read <= 0)
+                        return true;
+                    available += read;
+                }
+            }
+
+            //Anything after the last complete string is ignored, and would be joined by the strings appended after it.
+            const char * str;
+            size_t length;
+            if (!Format::find(&block[0], available, pos, str, length))
+                return true;
+            pos = Format::next(pos, length);
+        }
+        return pos != end;
+    } catch (ios_base::failure& e) {
+        return true;
+    }
+}
+
+//Copy all strings out of the source buffer and close it.
+void _strings_handle_int::Detach() {
+    FindUnreferenced();
+
+    const char * sourceStart = (const char*)source.data();
+    const char * sourceEnd = sourceStart + source.size();
+    for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it)
+        it->second.move_to(arena, sourceStart, sourceEnd, true);
+    for (vector<string_entry>::iterator it=unrefStrings.begin(), endIt=unrefStrings.end(); it != endIt; ++it)
+        it->move_to(arena, sourceStart, sourceEnd, true);
+    source.close();
+}
+
+//Copy a string into the arena, returning an entry for it.
+string_entry _strings_handle_int::Store(const char * str) {
+    const size_t length = strlen(str);
+    return string_entry(arena.store(str, length), length, true);
+}
+
+//Copy the strings still in use into a new arena if most of the arena is taken up by replaced strings.
+void _strings_handle_int::Compact() {
+    const char * sourceStart = (const char*)source.data();
+    const char * sourceEnd = sourceStart + source.size();
+
+    size_t liveSize = 0;
+    for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it)
+        liveSize += arena_size(it->second, sourceStart, sourceEnd);
+    for (vector<string_entry>::iterator it=unrefStrings.begin(), endIt=unrefStrings.end(); it != endIt; ++it)
+        liveSize += arena_size(*it, sourceStart, sourceEnd);
+    if (arena.size() <= 2 * liveSize)
+        return;
+
+    string_arena compacted;
+    for (string_index::iterator it=data.begin(), endIt=data.end(); it != endIt; ++it)
+        it->second.move_to(compacted, sourceStart, sourceEnd, false);
+    for (vector<string_entry>::iterator it=unrefStrings.begin(), endIt=unrefStrings.end(); it != endIt; ++it)
+        it->move_to(compacted, sourceStart, sourceEnd, false);
+    arena.swap(compacted);
+}
+
+_strings_iter_int::_strings_iter_int(_strings_handle_int * sh, const unsigned int order) : handle(sh), position(0) {
+    ids.reserve(sh->data.size());
+    if (order == LIBSTRINGS_ORDER_OFFSET) {
+        //Sort on offset then ID in one go. Strings that weren't read from the file have the highest offset, so come last.
+        vector<uint64_t> keys;
+        keys.reserve(sh->data.size());
+        for (string_index::iterator it=sh->data.begin(), endIt=sh->data.end(); it != endIt; ++it)
+            keys.push_back(((uint64_t)it->second.offset() << 32) | it->first);
+        sort(keys.begin(), keys.end());
+        for (vector<uint64_t>::const_iterator it=keys.begin(), endIt=keys.end(); it != endIt; ++it)
+            ids.push_back((uint32_t)*it);
+    } else {
+        for (string_index::iterator it=sh->data.begin(), endIt=sh->data.end(); it != endIt; ++it)
+            ids.push_back(it->first);
+        if (order == LIBSTRINGS_ORDER_ID)
+            sort(ids.begin(), ids.end());
+    }
+}
+
+bool _strings_iter_int::Next(uint32_t& id, string_entry *& entry) {
+    //Skip any IDs that have been removed since the cursor was created.
+    while (position < ids.size()) {
+        string_index::iterator it = handle->data.find(ids[position]);
+        position++;
+        if (it != handle->data.end()) {
+            id = it->first;
+            entry = &it->second;
+            return true;
+        }
+    }
+    return false;
 }
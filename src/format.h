@@ -26,38 +26,220 @@
 
 #include "libstrings.h"
 #include "helpers.h"
+#include "arena.h"
+#include "buffer.h"
+#include "index.h"
+#include "stats.h"
 #include <stdint.h>
+#include <ctime>
 #include <string>
+#include <vector>
 #include <boost/unordered_set.hpp>
 #include <boost/unordered_map.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include <map>
 
+namespace libstrings {
+    /* A string held by a handle. Entries don't own their strings, which are
+       either views into the file the handle was opened from, or stored in
+       the handle's arena. Strings are always null-terminated.
+       Strings read from a file hold their raw bytes until they are first
+       decoded, and must be decoded before they are used as UTF-8. They also
+       keep their raw bytes after decoding, so that strings that haven't been
+       changed can be saved again without being encoded. */
+    class string_entry {
+    public:
+        //The offset given to strings that weren't read from a file.
+        static const uint32_t noOffset = 0xFFFFFFFF;
+
+        string_entry();
+        string_entry(const char * str, const size_t length, const bool decoded, const uint32_t offset = noOffset);
+
+        const char * c_str() const;
+        size_t length() const;
+        std::string str() const;
+        bool is_decoded() const;
+
+        //The offset into the data block of the file the string was read from, or was last saved to if that was the same file.
+        uint32_t offset() const;
+        void set_offset(const uint32_t offset);
+
+        //The string's bytes as read from a file, or NULL if it was added or replaced. If the string had to be transcoded when it was decoded, these are in the fallback encoding, otherwise they are the same as the string.
+        const char * raw() const;
+        size_t raw_length() const;
+
+        //Transcode the string to UTF-8 from the given fallback encoding, if it isn't already valid UTF-8, storing the result in the arena. If stats aren't NULL, the decode is counted and timed in them.
+        void decode(const std::string& fallbackEncoding, string_arena& arena, st_stats * stats = NULL);
+
+        //Copy the string and its raw bytes into the given arena, if they are inside (or outside) the given range of memory.
+        void move_to(string_arena& arena, const char * begin, const char * end, const bool inside);
+    private:
+        const char * _str;
+        const char * _raw;
+        uint32_t _length;
+        uint32_t _rawLength;
+        uint32_t _offset;
+        bool _decoded;
+    };
+
+    typedef id_index<string_entry> string_index;
+
+    /* Memory holding the strings output by st_get_string(), st_get_strings()
+       and st_get_unref_strings(), which is freed when the function is next
+       called using it. */
+    struct output_buffers : boost::noncopyable {
+    public:
+        output_buffers();
+        ~output_buffers();
+
+        void FreeString();
+        void FreeStringDataArr();
+        void FreeStringArr();
+
+        st_string_data * stringDataArr;
+        char ** stringArr;
+        char * string;
+
+        //Array sizes.
+        size_t stringDataArrSize;
+        size_t stringArrSize;
+    };
+
+    //A request to cancel an operation running on another thread.
+    class cancel_flag : boost::noncopyable {
+    public:
+        cancel_flag();
+
+        void set();
+        bool is_set() const;
+    private:
+        mutable boost::mutex _mutex;
+        bool _set;
+    };
+}
+
 /* See here for format details: http://www.uesp.net/wiki/Tes5Mod:String_Table_File_Format
    Files read may be in UTF-8, Windows-1252 or Windows-1251.
    Files written should be in UTF-8.
    Store strings in UTF-8. */
 struct _strings_handle_int {
 public:
-    _strings_handle_int(const std::string& path, const std::string& fallbackEncoding);
+    //If threads is 0, the number of hardware threads is used.
+    _strings_handle_int(const std::string& path, const std::string& fallbackEncoding, const bool mapFile = false, unsigned int threads = 1);
+    //Parse a file held in memory. If borrow is true, the buffer is used in place, so must outlive the handle.
+    _strings_handle_int(const uint8_t * buffer, const size_t size, const bool isDotStrings, const std::string& fallbackEncoding, const bool borrow, unsigned int threads = 1);
+    //Copy the strings with IDs into a new handle, which doesn't depend on the other handle's storage and so can be saved while the other is changed.
+    explicit _strings_handle_int(_strings_handle_int& other);
     ~_strings_handle_int();
 
     //File data.
-    boost::unordered_map<uint32_t, std::string> data;       //Internal data storage. uint32_t is the string id and std::string is the string itself.
+    libstrings::string_index data;       //Internal data storage, mapping string IDs to their strings.
+
+    //Storage for strings that aren't in the source, i.e. those that have been transcoded, added or replaced.
+    libstrings::string_arena arena;
+
+    //The file the handle was opened from, and its contents. Strings in data may point into this. The path is empty if the handle was opened from memory.
+    std::string sourcePath;
+    std::string fallbackEncoding;
+    libstrings::file_buffer source;
+    bool isDotStrings;
+    size_t startOfData;
+    uint64_t sourceSize;  //The size of the file the handle was opened from, as last read or written by the handle.
+
+    //The last write time, header and directory of the file the handle was opened from, as last read or written by the handle, so that patching can check that the file hasn't been changed since.
+    std::time_t sourceWriteTime;
+    std::vector<char> sourceHead;
+    void RecordSource(const char * head, const size_t size);
+    bool SourceUnchanged() const;
+
+    //The offsets of the strings referenced by the source's directory, until unreferenced strings are found.
+    std::vector<uint32_t> referencedOffsets;
 
-    //External data pointers.
-    st_string_data * extStringDataArr;
-    char ** extStringArr;
-    char * extString;
+    //External data, used unless the handle is in concurrent mode, in which case each thread has its own.
+    libstrings::output_buffers extOutputs;
 
-    //External data array sizes.
-    size_t extStringDataArrSize;
-    size_t extStringArrSize;
+    //Whether the handle can be used by several threads at once, and the lock that allows it. Functions that only read strings take the lock shared, and all others take it exclusively.
+    bool concurrent;
+    boost::shared_mutex mutex;
+
+    //Statistics on the work done by the handle, and a pointer to them if they are being collected, or NULL otherwise.
+    st_stats stats;
+    st_stats * Stats() { return libstrings::statsEnabled ? &stats : NULL; }
+
+    //Decode all strings, so that reading them doesn't change the handle.
+    void DecodeAll();
+
+    //External file buffer, and its size.
+    boost::scoped_array<char> extBuffer;
+    size_t extBufferSize;
+
+    //All the unreferenced strings in the file. These aren't looked for until they are first needed.
+    std::vector<libstrings::string_entry> unrefStrings;
+    bool unrefScanned;
+    void FindUnreferenced();
+
+    //Save file data to given path, encoding strings using the given number of threads. If threads is 0, the number of hardware threads is used.
+    //If mergeTails is true, STRINGS files are saved with strings that end others stored as part of them.
+    //If cancel is given and set before the file is written, the save stops and throws.
+    void Save(const std::string& path, const std::string& encoding, unsigned int threads = 1, const bool mergeTails = false, const libstrings::cancel_flag * cancel = NULL);
+
+    //Save file data in the given format to extBuffer.
+    void SaveToMemory(const bool dotStrings, const std::string& encoding);
+
+    //Save changes to the file the handle was opened from, by rewriting its directory and appending new and changed strings.
+    void SavePatch(const std::string& encoding);
+
+    //Copy all strings out of the source buffer and close it.
+    void Detach();
+
+    //Copy a string into the arena, returning an entry for it.
+    libstrings::string_entry Store(const char * str);
+
+    //Copy the strings still in use into a new arena if most of the arena is taken up by replaced strings.
+    void Compact();
+private:
+    //Parsing of the source. The name describes where the source came from, for use in error messages.
+    void Parse(const std::string& name, unsigned int threads);
+
+    //Parsing, specialised on the format of the strings in the data block.
+    template <class Format> void ReadDirectory(const uint32_t dirCount, const std::string& name, unsigned int threads);
+    template <class Format> void ScanDataBlock();
+
+    //Whether the given position in the data block of the file the handle was opened from falls inside a string, rather than between them.
+    template <class Format> bool SplitsString(const size_t position) const;
+
+    //Lay out file data in the given format, outputting the file's contents and returning its size.
+    size_t Layout(const bool dotStrings, const std::string& encoding, unsigned int threads, const bool mergeTails, boost::scoped_array<char>& buffer);
+};
+
+namespace libstrings {
+    //Holds a handle's lock until destroyed, if the handle is in concurrent mode.
+    class handle_lock : boost::noncopyable {
+    public:
+        handle_lock(_strings_handle_int * sh, const bool exclusive);
+        ~handle_lock();
+    private:
+        boost::shared_mutex * _mutex;
+        bool _exclusive;
+    };
+}
+
+//A cursor over the strings of a handle, which visits the IDs the handle had when it was created.
+struct _strings_iter_int {
+public:
+    _strings_iter_int(_strings_handle_int * sh, const unsigned int order);
 
-    //All the unreferenced strings in the file.
-    boost::unordered_set<std::string> unrefStrings;
+    //Outputs the next string that still exists in the handle, returning false if there are none left.
+    bool Next(uint32_t& id, libstrings::string_entry *& entry);
 
-    //Save file data to given path.
-    void Save(const std::string& path, const std::string& encoding);
+    _strings_handle_int * handle;
+private:
+    std::vector<uint32_t> ids;
+    size_t position;
 };
 
 #endif
@@ -22,13 +22,12 @@
 */
 
 #include "helpers.h"
+#include "codepages.h"
 #include "libstrings.h"
 #include "error.h"
 
 #include <cstring>
 
-#include <source/utf8.h>
-
 #include <boost/locale.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -42,24 +41,54 @@ namespace libstrings {
         return strcpy(p, str.c_str());
     }
 
+    char * ToNewCString(const char * str, const size_t length) {
+        char * p = new char[length + 1];
+        memcpy(p, str, length);
+        p[length] = '\0';
+        return p;
+    }
+
     std::string ToUTF8(const std::string& str, const std::string& encoding) {
-        if (utf8::is_valid(str.begin(), str.end()) || boost::iequals("UTF-8", encoding))
+        if (IsValidUTF8(str.data(), str.length()) || boost::iequals("UTF-8", encoding))
             return str;
 
+        //Use the lookup tables for the common codepages, and boost::locale for anything else.
+        const codepage * cp = codepage::get(encoding);
+        if (cp != NULL) {
+            string out;
+            if (!cp->decode(str.data(), str.length(), out))
+                throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + str + "\" cannot be encoded in " + encoding + ".");
+            return out;
+        }
+
         try {
             return boost::locale::conv::to_utf<char>(str, encoding, boost::locale::conv::stop);
         } catch (boost::locale::conv::conversion_error& e) {
             throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + str + "\" cannot be encoded in " + encoding + ".");
+        } catch (boost::locale::conv::invalid_charset_error& e) {
+            //Thrown for encodings boost::locale doesn't know, which can happen on worker threads that must only throw errors.
+            throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "\"" + encoding + "\" is not a supported encoding.");
         }
     }
 
     std::string FromUTF8(const std::string& str, const std::string& encoding) {
         if (boost::iequals("UTF-8", encoding))
             return str;
+
+        const codepage * cp = codepage::get(encoding);
+        if (cp != NULL) {
+            string out;
+            if (!cp->encode(str.data(), str.length(), out))
+                throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + str + "\" cannot be encoded in " + encoding + ".");
+            return out;
+        }
+
         try {
             return boost::locale::conv::from_utf<char>(str, encoding, boost::locale::conv::stop);
         } catch (boost::locale::conv::conversion_error& e) {
             throw error(LIBSTRINGS_ERROR_BAD_STRING, "\"" + str + "\" cannot be encoded in " + encoding + ".");
+        } catch (boost::locale::conv::invalid_charset_error& e) {
+            throw error(LIBSTRINGS_ERROR_INVALID_ARGS, "\"" + encoding + "\" is not a supported encoding.");
         }
     }
 }
@@ -30,6 +30,17 @@
 namespace libstrings {
         // std::string to null-terminated uint8_t string converter.
         char * ToNewCString(const std::string& str);
+        char * ToNewCString(const char * str, const size_t length);
+
+        // Checks if the given string is valid UTF-8.
+        bool IsValidUTF8(const char * str, const size_t length);
+
+        // The implementations IsValidUTF8 chooses between, so that they can
+        // be checked against each other. HasUTF8Validator returns false if
+        // the implementation isn't built in or isn't supported by the CPU.
+        enum utf8_validator { UTF8_VALIDATOR_SCALAR, UTF8_VALIDATOR_SSE42, UTF8_VALIDATOR_AVX2 };
+        bool HasUTF8Validator(const utf8_validator validator);
+        bool IsValidUTF8With(const utf8_validator validator, const char * str, const size_t length);
 
         // Encoding conversions. 'encoding' can be of the form "Windows-*".
         // For ToUTF8, 'encoding' is actually the fallback encoding, and the
@@ -0,0 +1,156 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/* Compares the flat ID index against boost::unordered_map for the
+   operations handles perform: building from a directory, looking up IDs
+   that exist and that don't, iterating, and removing strings. */
+
+#include "index.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+
+#include <boost/unordered_map.hpp>
+
+using namespace std;
+
+namespace {
+    //The same size and layout as a handle's string entries.
+    struct entry {
+        entry() : str(NULL), length(0), decoded(true) {}
+        entry(const uint32_t i) : str(NULL), length(i), decoded(false) {}
+
+        const char * str;
+        uint32_t length;
+        bool decoded;
+    };
+
+    //Adapters giving both tables the same interface.
+    struct map_ops {
+        typedef boost::unordered_map<uint32_t, entry> table;
+        static void reserve(table& t, size_t n) { t.rehash(n); }
+        static void insert(table& t, uint32_t id) { t.insert(pair<uint32_t, entry>(id, entry(id))); }
+        static bool contains(table& t, uint32_t id) { return t.find(id) != t.end(); }
+        static void erase(table& t, uint32_t id) { t.erase(id); }
+        static uint64_t sum(table& t) {
+            uint64_t s = 0;
+            for (table::iterator it=t.begin(), endIt=t.end(); it != endIt; ++it)
+                s += it->second.length;
+            return s;
+        }
+    };
+
+    struct index_ops {
+        typedef libstrings::id_index<entry> table;
+        static void reserve(table& t, size_t n) { t.reserve(n); }
+        static void insert(table& t, uint32_t id) { t.insert(id, entry(id)); }
+        static bool contains(table& t, uint32_t id) { return t.find(id) != t.end(); }
+        static void erase(table& t, uint32_t id) { t.erase(id); }
+        static uint64_t sum(table& t) {
+            uint64_t s = 0;
+            for (table::iterator it=t.begin(), endIt=t.end(); it != endIt; ++it)
+                s += it->second.length;
+            return s;
+        }
+    };
+
+    double elapsed(const clock_t start) {
+        return 1000.0 * (clock() - start) / CLOCKS_PER_SEC;
+    }
+
+    //Fill in the table and run each operation on it, printing the average time taken by each.
+    template <class Ops>
+    void run(const char * name, const vector<uint32_t>& ids, const vector<uint32_t>& lookups, const vector<uint32_t>& misses, const size_t rounds) {
+        double build = 0, hit = 0, miss = 0, iterate = 0, remove = 0;
+        uint64_t check = 0;
+
+        for (size_t r=0; r < rounds; r++) {
+            typename Ops::table t;
+
+            clock_t start = clock();
+            Ops::reserve(t, ids.size());
+            for (size_t i=0; i < ids.size(); i++)
+                Ops::insert(t, ids[i]);
+            build += elapsed(start);
+
+            start = clock();
+            for (size_t i=0; i < lookups.size(); i++)
+                check += Ops::contains(t, lookups[i]);
+            hit += elapsed(start);
+
+            start = clock();
+            for (size_t i=0; i < misses.size(); i++)
+                check += Ops::contains(t, misses[i]);
+            miss += elapsed(start);
+
+            start = clock();
+            check += Ops::sum(t);
+            iterate += elapsed(start);
+
+            start = clock();
+            for (size_t i=0; i < ids.size(); i += 2)
+                Ops::erase(t, ids[i]);
+            for (size_t i=0; i < lookups.size(); i++)
+                check += Ops::contains(t, lookups[i]);
+            remove += elapsed(start);
+        }
+
+        printf("%-16s %10.2f %10.2f %10.2f %10.2f %10.2f   (%llu)\n", name, build / rounds, hit / rounds, miss / rounds, iterate / rounds, remove / rounds, (unsigned long long)check);
+    }
+}
+
+int main() {
+    const size_t sizes[] = { 1000, 100000, 1000000 };
+
+    printf("Times are in milliseconds, averaged over each round.\n");
+    for (size_t s=0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const size_t n = sizes[s];
+        const size_t rounds = max((size_t)1, 2000000 / n);
+
+        //String IDs are mostly sequential, with occasional gaps.
+        vector<uint32_t> ids(n);
+        uint32_t id = 1;
+        for (size_t i=0; i < n; i++) {
+            ids[i] = id;
+            id += (rand() % 8 == 0) ? 2 + rand() % 64 : 1;
+        }
+
+        vector<uint32_t> lookups(ids);
+        random_shuffle(lookups.begin(), lookups.end());
+
+        vector<uint32_t> misses(n);
+        for (size_t i=0; i < n; i++)
+            misses[i] = id + (uint32_t)rand();
+
+        printf("\n%lu IDs, %lu rounds\n", (unsigned long)n, (unsigned long)rounds);
+        printf("%-16s %10s %10s %10s %10s %10s\n", "", "build", "hit", "miss", "iterate", "erase");
+        run<map_ops>("unordered_map", ids, lookups, misses, rounds);
+        run<index_ops>("id_index", ids, lookups, misses, rounds);
+    }
+
+    return 0;
+}
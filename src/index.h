@@ -0,0 +1,224 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_INDEX_H__
+#define __LIBSTRINGS_INDEX_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#   include <xmmintrin.h>
+#   define LIBSTRINGS_PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#   define LIBSTRINGS_PREFETCH(p) __builtin_prefetch(p)
+#endif
+
+namespace libstrings {
+
+    /* A hash table mapping string IDs to values, stored in a single flat
+       array using open addressing with linear probing. Removal shifts later
+       entries in the same probe run back into the gap, so no tombstones are
+       left behind and lookups never slow down as entries are removed.
+       Iteration order is unspecified, and inserting or erasing invalidates
+       all iterators. */
+    template <class T>
+    class id_index {
+    public:
+        struct value_type {
+            uint32_t first;
+            bool occupied;
+            T second;
+        };
+
+        class iterator {
+        public:
+            iterator() : _slot(NULL), _end(NULL) {}
+            iterator(value_type * slot, value_type * end) : _slot(slot), _end(end) {
+                skip();
+            }
+
+            value_type& operator * () const { return *_slot; }
+            value_type * operator -> () const { return _slot; }
+
+            iterator& operator ++ () {
+                ++_slot;
+                skip();
+                return *this;
+            }
+
+            bool operator == (const iterator& other) const { return _slot == other._slot; }
+            bool operator != (const iterator& other) const { return _slot != other._slot; }
+        private:
+            void skip() {
+                while (_slot != _end && !_slot->occupied)
+                    ++_slot;
+            }
+
+            value_type * _slot;
+            value_type * _end;
+        };
+
+        id_index() : _size(0), _mask(0), _shift(32) {}
+
+        iterator begin() {
+            return iterator(first(), last());
+        }
+
+        iterator end() {
+            return iterator(last(), last());
+        }
+
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        iterator find(const uint32_t id) {
+            if (_size == 0)
+                return end();
+
+            for (size_t i = home(id);; i = (i + 1) & _mask) {
+                value_type& slot = _slots[i];
+                if (!slot.occupied)
+                    return end();
+                if (slot.first == id)
+                    return iterator(&slot, last());
+            }
+        }
+
+        //Start loading the slot the given ID would be found in, ahead of looking it up.
+        void prefetch(const uint32_t id) const {
+            if (!_slots.empty())
+                LIBSTRINGS_PREFETCH(&_slots[home(id)]);
+        }
+
+        //Returns false if the ID is already present, in which case its value is left unchanged.
+        bool insert(const uint32_t id, const T& value) {
+            if ((_size + 1) * 4 > _slots.size() * 3)
+                reserve(_size + 1);
+
+            size_t i = home(id);
+            for (; _slots[i].occupied; i = (i + 1) & _mask) {
+                if (_slots[i].first == id)
+                    return false;
+            }
+
+            _slots[i].first = id;
+            _slots[i].second = value;
+            _slots[i].occupied = true;
+            _size++;
+            return true;
+        }
+
+        void erase(iterator it) {
+            size_t gap = &*it - first();
+
+            //Move back any later entries in the probe run that would be unreachable once the gap is left empty.
+            for (size_t i = (gap + 1) & _mask; _slots[i].occupied; i = (i + 1) & _mask) {
+                const size_t h = home(_slots[i].first);
+                const bool reachable = gap <= i ? (gap < h && h <= i) : (gap < h || h <= i);
+                if (!reachable) {
+                    _slots[gap] = _slots[i];
+                    gap = i;
+                }
+            }
+
+            _slots[gap].occupied = false;
+            _slots[gap].second = T();
+            _size--;
+        }
+
+        bool erase(const uint32_t id) {
+            iterator it = find(id);
+            if (it == end())
+                return false;
+            erase(it);
+            return true;
+        }
+
+        //Makes sure that count entries can be held without the table growing.
+        void reserve(const size_t count) {
+            size_t capacity = 16;
+            while (capacity * 3 < std::max(count, _size) * 4)
+                capacity *= 2;
+            if (capacity <= _slots.size())
+                return;
+
+            std::vector<value_type> old(capacity, empty_slot());
+            old.swap(_slots);
+            _mask = capacity - 1;
+            _shift = 32;
+            for (size_t c = capacity; c > 1; c >>= 1)
+                _shift--;
+
+            _size = 0;
+            for (typename std::vector<value_type>::iterator it = old.begin(), endIt = old.end(); it != endIt; ++it) {
+                if (it->occupied)
+                    insert(it->first, it->second);
+            }
+        }
+
+        void clear() {
+            std::vector<value_type>().swap(_slots);
+            _size = 0;
+            _mask = 0;
+            _shift = 32;
+        }
+
+        void swap(id_index& other) {
+            _slots.swap(other._slots);
+            std::swap(_size, other._size);
+            std::swap(_mask, other._mask);
+            std::swap(_shift, other._shift);
+        }
+    private:
+        static value_type empty_slot() {
+            value_type slot;
+            slot.first = 0;
+            slot.occupied = false;
+            slot.second = T();
+            return slot;
+        }
+
+        //IDs are often sequential, so scatter them with Fibonacci hashing, taking the top bits of the product.
+        size_t home(const uint32_t id) const {
+            return (uint32_t)(id * 2654435769U) >> _shift;
+        }
+
+        value_type * first() {
+            return _slots.empty() ? NULL : &_slots[0];
+        }
+
+        value_type * last() {
+            return _slots.empty() ? NULL : &_slots[0] + _slots.size();
+        }
+
+        std::vector<value_type> _slots;
+        size_t _size;
+        size_t _mask;
+        unsigned int _shift;
+    };
+}
+
+#endif
@@ -24,8 +24,15 @@
 #include "libstrings.h"
 #include "error.h"
 #include "format.h"
+#include "bundle.h"
+#include "collection.h"
+#include "stats.h"
+#include "trace.h"
+#include "async.h"
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/detail/utf8_codecvt_facet.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/unordered_set.hpp>
 #include <locale>
 #include <sstream>
@@ -42,17 +49,51 @@ const unsigned int LIBSTRINGS_VERSION_MAJOR = 2;
 const unsigned int LIBSTRINGS_VERSION_MINOR = 0;
 const unsigned int LIBSTRINGS_VERSION_PATCH = 0;
 
-const char * extErrorString = NULL;
+//Each thread has its own error message, so that threads using different handles don't overwrite each other's errors.
+boost::thread_specific_ptr<string> extErrorString;
+
+//Each thread also has its own output buffers, for use with handles in concurrent mode.
+boost::thread_specific_ptr<output_buffers> extThreadOutputs;
 
 unsigned int c_error(const error& e) {
-    extErrorString = ToNewCString(e.what());
+    try {
+        if (extErrorString.get() == NULL)
+            extErrorString.reset(new string());
+        *extErrorString = e.what();
+    } catch (bad_alloc&) {
+        extErrorString.reset();
+    }
     return e.code();
 }
 
+//Get the buffers that strings should be output to for the given handle.
+output_buffers& Outputs(st_strings_handle sh) {
+    if (!sh->concurrent)
+        return sh->extOutputs;
+
+    if (extThreadOutputs.get() == NULL)
+        extThreadOutputs.reset(new output_buffers());
+    return *extThreadOutputs;
+}
+
 unsigned int c_error(const unsigned int code, const std::string& what) {
     return c_error(error(code, what.c_str()));
 }
 
+//Set the locale to get encoding conversions working correctly. This only needs doing once.
+boost::once_flag localeFlag = BOOST_ONCE_INIT;
+
+void SetLocale() {
+    setlocale(LC_CTYPE, "");
+    locale global_loc = locale();
+    locale loc(global_loc, new boost::filesystem::detail::utf8_codecvt_facet());
+    boost::filesystem::path::imbue(loc);
+}
+
+void InitLocale() {
+    boost::call_once(localeFlag, &SetLocale);
+}
+
 
 /*------------------------------
    Constants
@@ -65,7 +106,18 @@ const unsigned int LIBSTRINGS_ERROR_NO_MEM              = 2;
 const unsigned int LIBSTRINGS_ERROR_FILE_READ_FAIL      = 3;
 const unsigned int LIBSTRINGS_ERROR_FILE_WRITE_FAIL     = 4;
 const unsigned int LIBSTRINGS_ERROR_BAD_STRING          = 5;
-const unsigned int LIBSTRINGS_RETURN_MAX                = LIBSTRINGS_ERROR_BAD_STRING;
+const unsigned int LIBSTRINGS_ERROR_CANCELLED           = 6;
+const unsigned int LIBSTRINGS_RETURN_MAX                = LIBSTRINGS_ERROR_CANCELLED;
+
+const unsigned int LIBSTRINGS_ORDER_NONE                = 0;
+const unsigned int LIBSTRINGS_ORDER_ID                  = 1;
+const unsigned int LIBSTRINGS_ORDER_OFFSET              = 2;
+
+const unsigned int LIBSTRINGS_SAVE_MERGE_TAILS          = 1;
+
+const unsigned int LIBSTRINGS_FILE_STRINGS              = 0;
+const unsigned int LIBSTRINGS_FILE_DLSTRINGS            = 1;
+const unsigned int LIBSTRINGS_FILE_ILSTRINGS            = 2;
 
 
 /*------------------------------
@@ -99,16 +151,14 @@ LIBSTRINGS unsigned int st_get_error_message(const char ** const details) {
     if (details == NULL)
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    *details = extErrorString;
+    *details = extErrorString.get() == NULL ? NULL : extErrorString->c_str();
 
     return LIBSTRINGS_OK;
 }
 
 LIBSTRINGS void st_cleanup() {
-    if (extErrorString != NULL) {
-        delete [] extErrorString;
-        extErrorString = NULL;
-    }
+    extErrorString.reset();
+    extThreadOutputs.reset();
 }
 
 /*----------------------------------
@@ -119,18 +169,86 @@ LIBSTRINGS void st_cleanup() {
    sh. If the strings file doesn't exist then a handle for a new file will be
    created. */
 LIBSTRINGS unsigned int st_open(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding) {
+    LIBSTRINGS_TRACE("st_open");
+
     if (sh == NULL || path == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    //Set the locale to get encoding conversions working correctly.
-    setlocale(LC_CTYPE, "");
-    locale global_loc = locale();
-    locale loc(global_loc, new boost::filesystem::detail::utf8_codecvt_facet());
-    boost::filesystem::path::imbue(loc);
+    InitLocale();
 
     //Create handle.
     try {
         *sh = new _strings_handle_int(path, fallbackEncoding);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Opens a STRINGS, ILSTRINGS or DLSTRINGS file at path by mapping it into
+   memory, returning a handle sh. Otherwise behaves as st_open. */
+LIBSTRINGS unsigned int st_open_mapped(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding) {
+    LIBSTRINGS_TRACE("st_open_mapped");
+
+    if (sh == NULL || path == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    InitLocale();
+
+    //Create handle.
+    try {
+        *sh = new _strings_handle_int(path, fallbackEncoding, true);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Opens a STRINGS, ILSTRINGS or DLSTRINGS file at path, returning a handle
+   sh, reading its directory using the given number of threads. */
+LIBSTRINGS unsigned int st_open_ex(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding, const unsigned int threads) {
+    LIBSTRINGS_TRACE("st_open_ex");
+
+    if (sh == NULL || path == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    InitLocale();
+
+    //Create handle.
+    try {
+        *sh = new _strings_handle_int(path, fallbackEncoding, false, threads);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Opens a STRINGS, ILSTRINGS or DLSTRINGS file held in memory, returning a
+   handle sh. */
+LIBSTRINGS unsigned int st_open_from_memory(st_strings_handle * const sh, const uint8_t * const buffer, const size_t size, const unsigned int fileType, const char * const fallbackEncoding, const bool borrow) {
+    LIBSTRINGS_TRACE("st_open_from_memory");
+
+    if (sh == NULL || (buffer == NULL && size > 0)) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    else if (fileType != LIBSTRINGS_FILE_STRINGS && fileType != LIBSTRINGS_FILE_DLSTRINGS && fileType != LIBSTRINGS_FILE_ILSTRINGS)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Invalid file type given.");
+
+    InitLocale();
+
+    //Create handle.
+    try {
+        *sh = new _strings_handle_int(buffer, size, fileType == LIBSTRINGS_FILE_STRINGS, fallbackEncoding, borrow);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
     } catch (error& e) {
         return c_error(e);
     }
@@ -140,18 +258,145 @@ LIBSTRINGS unsigned int st_open(st_strings_handle * const sh, const char * const
 
 /* Saves the strings associated with the given handle to the given path. */
 LIBSTRINGS unsigned int st_save(st_strings_handle sh, const char * const path, const char * const encoding) {
+    LIBSTRINGS_TRACE("st_save");
+
     if (sh == NULL || path == NULL)
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
+    handle_lock lock(sh, true);
+
     try {
         sh->Save(path, encoding);
-    } catch (error e) {
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Saves the strings associated with the given handle to the given path,
+   encoding them using the given number of threads, with the given options. */
+LIBSTRINGS unsigned int st_save_ex(st_strings_handle sh, const char * const path, const char * const encoding, const unsigned int threads, const unsigned int options) {
+    LIBSTRINGS_TRACE("st_save_ex");
+
+    if (sh == NULL || path == NULL)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    else if ((options & ~LIBSTRINGS_SAVE_MERGE_TAILS) != 0)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Invalid save options given.");
+
+    handle_lock lock(sh, true);
+
+    try {
+        sh->Save(path, encoding, threads, (options & LIBSTRINGS_SAVE_MERGE_TAILS) != 0);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Saves the strings associated with the given handle to a buffer. */
+LIBSTRINGS unsigned int st_save_to_memory(st_strings_handle sh, const unsigned int fileType, const char * const encoding, const uint8_t ** const buffer, size_t * const size) {
+    LIBSTRINGS_TRACE("st_save_to_memory");
+
+    if (sh == NULL || encoding == NULL || buffer == NULL || size == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    else if (fileType != LIBSTRINGS_FILE_STRINGS && fileType != LIBSTRINGS_FILE_DLSTRINGS && fileType != LIBSTRINGS_FILE_ILSTRINGS)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Invalid file type given.");
+
+    handle_lock lock(sh, true);
+
+    //Init values.
+    *buffer = NULL;
+    *size = 0;
+
+    try {
+        sh->SaveToMemory(fileType == LIBSTRINGS_FILE_STRINGS, encoding);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    *buffer = reinterpret_cast<const uint8_t*>(sh->extBuffer.get());
+    *size = sh->extBufferSize;
+
+    return LIBSTRINGS_OK;
+}
+
+/* Saves changes to the strings associated with the given handle to the
+   file it was opened from, in place. */
+LIBSTRINGS unsigned int st_save_patch(st_strings_handle sh, const char * const encoding) {
+    LIBSTRINGS_TRACE("st_save_patch");
+
+    if (sh == NULL || encoding == NULL)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    else if (sh->sourcePath.empty())
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The handle was not opened from a file.");
+
+    handle_lock lock(sh, true);
+
+    try {
+        sh->SavePatch(encoding);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
         return c_error(e);
     }
 
     return LIBSTRINGS_OK;
 }
 
+/* Rewrites the file the given handle was opened from. */
+LIBSTRINGS unsigned int st_compact(st_strings_handle sh, const char * const encoding) {
+    LIBSTRINGS_TRACE("st_compact");
+
+    if (sh == NULL || encoding == NULL)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    else if (sh->sourcePath.empty())
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The handle was not opened from a file.");
+
+    handle_lock lock(sh, true);
+
+    try {
+        sh->Save(sh->sourcePath, encoding);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Sets whether the given handle can be used by several threads at once. */
+LIBSTRINGS unsigned int st_set_concurrent(st_strings_handle sh, const bool concurrent) {
+    LIBSTRINGS_TRACE("st_set_concurrent");
+
+    if (sh == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    handle_lock lock(sh, true);
+
+    //Reading strings decodes them, so decode them all now so that readers don't change the handle.
+    try {
+        if (concurrent)
+            sh->DecodeAll();
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    sh->concurrent = concurrent;
+
+    return LIBSTRINGS_OK;
+}
+
 /* Closes the file associated with the given handle, freeing any memory
    allocated during its use. */
 LIBSTRINGS void st_close(st_strings_handle sh) {
@@ -159,23 +404,175 @@ LIBSTRINGS void st_close(st_strings_handle sh) {
 }
 
 
+/*------------------------------
+   Bundle Functions
+------------------------------*/
+
+/* Opens the STRINGS, DLSTRINGS and ILSTRINGS files with the given base path,
+   returning a bundle holding a handle for each. */
+LIBSTRINGS unsigned int st_bundle_open(st_strings_bundle * const bundle, const char * const basePath, const char * const fallbackEncoding, const bool mapFiles) {
+    LIBSTRINGS_TRACE("st_bundle_open");
+
+    if (bundle == NULL || basePath == NULL || fallbackEncoding == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    InitLocale();
+
+    //Create bundle.
+    try {
+        *bundle = new _strings_bundle_int(basePath, fallbackEncoding, mapFiles);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Outputs the handle for the file of the given type in the bundle. */
+LIBSTRINGS unsigned int st_bundle_get_handle(st_strings_bundle bundle, const unsigned int fileType, st_strings_handle * const sh) {
+    if (bundle == NULL || sh == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    else if (fileType != LIBSTRINGS_FILE_STRINGS && fileType != LIBSTRINGS_FILE_DLSTRINGS && fileType != LIBSTRINGS_FILE_ILSTRINGS)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Invalid file type given.");
+
+    *sh = bundle->handles[fileType];
+
+    return LIBSTRINGS_OK;
+}
+
+/* Saves all the files in the bundle to the given base path. */
+LIBSTRINGS unsigned int st_bundle_save(st_strings_bundle bundle, const char * const basePath, const char * const encoding) {
+    LIBSTRINGS_TRACE("st_bundle_save");
+
+    if (bundle == NULL || basePath == NULL || encoding == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    try {
+        bundle->Save(basePath, encoding);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Closes the bundle and its handles, freeing any memory allocated during
+   their use. */
+LIBSTRINGS void st_bundle_close(st_strings_bundle bundle) {
+    delete bundle;
+}
+
+
+/*------------------------------
+   Collection Functions
+------------------------------*/
+
+/* Loads all the STRINGS, ILSTRINGS and DLSTRINGS files in the given
+   directory, returning a collection holding a handle or error for each. */
+LIBSTRINGS unsigned int st_collection_open_dir(st_strings_collection * const collection, const char * const path, const char * const fallbackEncoding, const bool mapFiles, const unsigned int threads) {
+    LIBSTRINGS_TRACE("st_collection_open_dir");
+
+    if (collection == NULL || path == NULL || fallbackEncoding == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    InitLocale();
+
+    //Create collection.
+    try {
+        *collection = new _strings_collection_int(_strings_collection_int::ListDirectory(path), fallbackEncoding, mapFiles, threads);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Loads the given files, returning a collection holding a handle or error
+   for each. */
+LIBSTRINGS unsigned int st_collection_open_paths(st_strings_collection * const collection, const char * const * const paths, const size_t numPaths, const char * const fallbackEncoding, const bool mapFiles, const unsigned int threads) {
+    LIBSTRINGS_TRACE("st_collection_open_paths");
+
+    if (collection == NULL || (paths == NULL && numPaths > 0) || fallbackEncoding == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    InitLocale();
+
+    //Create collection.
+    try {
+        vector<string> pathVec;
+        pathVec.reserve(numPaths);
+        for (size_t i=0; i < numPaths; i++) {
+            if (paths[i] == NULL)
+                return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+            pathVec.push_back(paths[i]);
+        }
+
+        *collection = new _strings_collection_int(pathVec, fallbackEncoding, mapFiles, threads);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Outputs the number of files in the collection. */
+LIBSTRINGS unsigned int st_collection_get_size(st_strings_collection collection, size_t * const numEntries) {
+    if (collection == NULL || numEntries == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    *numEntries = collection->entries.size();
+
+    return LIBSTRINGS_OK;
+}
+
+/* Outputs the path, handle and load result of the file at the given index
+   in the collection. */
+LIBSTRINGS unsigned int st_collection_get_entry(st_strings_collection collection, const size_t index, const char ** const path, st_strings_handle * const sh, unsigned int * const code, const char ** const message) {
+    if (collection == NULL || path == NULL || sh == NULL || code == NULL || message == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    else if (index >= collection->entries.size())
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Index is out of range.");
+
+    const _strings_collection_int::entry& file = collection->entries[index];
+    *path = file.path.c_str();
+    *sh = file.handle;
+    *code = file.code;
+    *message = file.code == LIBSTRINGS_OK ? NULL : file.message.c_str();
+
+    return LIBSTRINGS_OK;
+}
+
+/* Closes the collection and its handles, freeing any memory allocated
+   during their use. */
+LIBSTRINGS void st_collection_close(st_strings_collection collection) {
+    delete collection;
+}
+
+
 /*------------------------------
    String Reading Functions
 ------------------------------*/
 
 /* Gets an array of all strings (with assigned IDs) in the file. */
 LIBSTRINGS unsigned int st_get_strings(st_strings_handle sh, st_string_data ** strings, size_t * numStrings) {
+    LIBSTRINGS_TRACE("st_get_strings");
+
     if (sh == NULL || strings == NULL || numStrings == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
+    handle_lock lock(sh, false);
+
     //Free memory if in use.
-    if (sh->extStringDataArr != NULL) {
-        for (size_t i=0; i < sh->extStringDataArrSize; i++)
-            delete [] sh->extStringDataArr[i].data;
-        delete [] sh->extStringDataArr;
-        sh->extStringDataArr = NULL;
-        sh->extStringDataArrSize = 0;
-    }
+    output_buffers& outputs = Outputs(sh);
+    outputs.FreeStringDataArr();
 
     //Init values.
     *strings = NULL;
@@ -184,14 +581,15 @@ LIBSTRINGS unsigned int st_get_strings(st_strings_handle sh, st_string_data ** s
     if (sh->data.empty())
         return LIBSTRINGS_OK;
 
-    sh->extStringDataArrSize = sh->data.size();
+    outputs.stringDataArrSize = sh->data.size();
 
     try {
-        sh->extStringDataArr = new st_string_data[sh->extStringDataArrSize];
+        outputs.stringDataArr = new st_string_data[outputs.stringDataArrSize]();  //Zero the array so a failed decode can be cleaned up.
         size_t i=0;
-        for (boost::unordered_map<uint32_t, string>::iterator it=sh->data.begin(), endIt=sh->data.end(); it != endIt; ++it) {
-            sh->extStringDataArr[i].id = it->first;
-            sh->extStringDataArr[i].data = ToNewCString(it->second);
+        for (string_index::iterator it=sh->data.begin(), endIt=sh->data.end(); it != endIt; ++it) {
+            it->second.decode(sh->fallbackEncoding, sh->arena, sh->Stats());
+            outputs.stringDataArr[i].id = it->first;
+            outputs.stringDataArr[i].data = ToNewCString(it->second.c_str(), it->second.length());
             i++;
         }
     } catch (bad_alloc& e) {
@@ -200,41 +598,47 @@ LIBSTRINGS unsigned int st_get_strings(st_strings_handle sh, st_string_data ** s
         return c_error(e);
     }
 
-    *strings = sh->extStringDataArr;
-    *numStrings = sh->extStringDataArrSize;
+    *strings = outputs.stringDataArr;
+    *numStrings = outputs.stringDataArrSize;
 
     return LIBSTRINGS_OK;
 }
 
 /* Gets an array of any strings in the file that are not assigned IDs. */
 LIBSTRINGS unsigned int st_get_unref_strings(st_strings_handle sh, char *** strings, size_t * numStrings) {
+    LIBSTRINGS_TRACE("st_get_unref_strings");
+
     if (sh == NULL || strings == NULL || numStrings == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
+    handle_lock lock(sh, false);
+
     //Free memory if in use.
-    if (sh->extStringArr != NULL) {
-        for (size_t i=0; i < sh->extStringArrSize; i++)
-            delete [] sh->extStringArr[i];
-        delete [] sh->extStringArr;
-        sh->extStringArr = NULL;
-        sh->extStringArrSize = 0;
-    }
+    output_buffers& outputs = Outputs(sh);
+    outputs.FreeStringArr();
 
     //Init values.
     *strings = NULL;
     *numStrings = 0;
 
-    if (sh->unrefStrings.empty())
-        return LIBSTRINGS_OK;
-
-    //Allocate memory.
-    sh->extStringArrSize = sh->unrefStrings.size();
     try {
-        sh->extStringArr = new char*[sh->extStringArrSize];
-        //Now loop through the offsets, getting the string for each.
+        //Decode the strings, skipping any that are duplicates of others.
+        sh->FindUnreferenced();
+        boost::unordered_set<string> unrefStrings;
+        for (vector<string_entry>::iterator it=sh->unrefStrings.begin(), endIt=sh->unrefStrings.end(); it != endIt; ++it) {
+            it->decode(sh->fallbackEncoding, sh->arena, sh->Stats());
+            unrefStrings.insert(string(it->c_str(), it->length()));
+        }
+
+        if (unrefStrings.empty())
+            return LIBSTRINGS_OK;
+
+        //Allocate memory.
+        outputs.stringArrSize = unrefStrings.size();
+        outputs.stringArr = new char*[outputs.stringArrSize]();
         size_t i=0;
-        for (boost::unordered_set<string>::iterator it=sh->unrefStrings.begin(), endIt=sh->unrefStrings.end(); it != endIt; ++it) {
-            sh->extStringArr[i] = ToNewCString(*it);
+        for (boost::unordered_set<string>::iterator it=unrefStrings.begin(), endIt=unrefStrings.end(); it != endIt; ++it) {
+            outputs.stringArr[i] = ToNewCString(*it);
             i++;
         }
     } catch (bad_alloc& e) {
@@ -243,8 +647,8 @@ LIBSTRINGS unsigned int st_get_unref_strings(st_strings_handle sh, char *** stri
         return c_error(e);
     }
 
-    *strings = sh->extStringArr;
-    *numStrings = sh->extStringArrSize;
+    *strings = outputs.stringArr;
+    *numStrings = outputs.stringArrSize;
 
     return LIBSTRINGS_OK;
 }
@@ -254,33 +658,157 @@ LIBSTRINGS unsigned int st_get_string(st_strings_handle sh, const uint32_t strin
     if (sh == NULL || string == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
+    handle_lock lock(sh, false);
+
     //Free memory in use.
-    if (sh->extString != NULL) {
-        delete [] sh->extString;
-        sh->extString = NULL;
-    }
+    output_buffers& outputs = Outputs(sh);
+    outputs.FreeString();
 
     //Init value.
     *string = NULL;
 
     //Find string.
     try {
-        boost::unordered_map<uint32_t, std::string>::iterator it = sh->data.find(stringId);
-        if (it != sh->data.end())
-            sh->extString = ToNewCString(it->second);
-        else
+        string_index::iterator it = sh->data.find(stringId);
+        if (it == sh->data.end())
             return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
+
+        it->second.decode(sh->fallbackEncoding, sh->arena, sh->Stats());
+        outputs.string = ToNewCString(it->second.c_str(), it->second.length());
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    *string = outputs.string;
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets a view of the string with the given ID in the handle's own storage. */
+LIBSTRINGS unsigned int st_get_string_view(st_strings_handle sh, const uint32_t stringId, const char ** string, size_t * length) {
+    if (sh == NULL || string == NULL || length == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    handle_lock lock(sh, false);
+
+    //Init values.
+    *string = NULL;
+    *length = 0;
+
+    //Find string.
+    try {
+        string_index::iterator it = sh->data.find(stringId);
+        if (it == sh->data.end())
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
+
+        it->second.decode(sh->fallbackEncoding, sh->arena, sh->Stats());
+        *string = it->second.c_str();
+        *length = it->second.length();
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Gets views of the strings with the given IDs. */
+LIBSTRINGS unsigned int st_get_strings_by_ids(st_strings_handle sh, const uint32_t * const stringIds, const size_t numIds, st_string_view * const results) {
+    LIBSTRINGS_TRACE("st_get_strings_by_ids");
+
+    if (sh == NULL || (numIds > 0 && (stringIds == NULL || results == NULL))) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    handle_lock lock(sh, false);
+
+    //Look up IDs a little behind prefetching their slots, so that the memory accesses overlap.
+    const size_t prefetchDistance = 8;
+    for (size_t i=0; i < numIds && i < prefetchDistance; i++)
+        sh->data.prefetch(stringIds[i]);
+
+    try {
+        for (size_t i=0; i < numIds; i++) {
+            if (i + prefetchDistance < numIds)
+                sh->data.prefetch(stringIds[i + prefetchDistance]);
+
+            string_index::iterator it = sh->data.find(stringIds[i]);
+            if (it == sh->data.end()) {
+                results[i].data = NULL;
+                results[i].length = 0;
+                results[i].found = false;
+            } else {
+                it->second.decode(sh->fallbackEncoding, sh->arena, sh->Stats());
+                results[i].data = it->second.c_str();
+                results[i].length = it->second.length();
+                results[i].found = true;
+            }
+        }
     } catch (bad_alloc& e) {
         return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
     } catch (error& e) {
         return c_error(e);
     }
 
-    *string = sh->extString;
+    return LIBSTRINGS_OK;
+}
+
+/* Creates a cursor over the strings (with assigned IDs) in the file. */
+LIBSTRINGS unsigned int st_iter_begin(st_strings_handle sh, st_strings_iter * const iter, const unsigned int order) {
+    if (sh == NULL || iter == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+    else if (order != LIBSTRINGS_ORDER_NONE && order != LIBSTRINGS_ORDER_ID && order != LIBSTRINGS_ORDER_OFFSET)
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Invalid iteration order given.");
+
+    handle_lock lock(sh, false);
+
+    try {
+        *iter = new _strings_iter_int(sh, order);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    }
 
     return LIBSTRINGS_OK;
 }
 
+/* Gets the next string visited by the given cursor. */
+LIBSTRINGS unsigned int st_iter_next(st_strings_iter iter, uint32_t * const stringId, const char ** const string, size_t * const length) {
+    if (iter == NULL || stringId == NULL || string == NULL || length == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    handle_lock lock(iter->handle, false);
+
+    //Init values.
+    *stringId = 0;
+    *string = NULL;
+    *length = 0;
+
+    try {
+        uint32_t id;
+        string_entry * entry;
+        if (!iter->Next(id, entry))
+            return LIBSTRINGS_OK;
+
+        entry->decode(iter->handle->fallbackEncoding, iter->handle->arena, iter->handle->Stats());
+        *stringId = id;
+        *string = entry->c_str();
+        *length = entry->length();
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Destroys the given cursor. */
+LIBSTRINGS void st_iter_end(st_strings_iter iter) {
+    delete iter;
+}
+
 
 /*------------------------------
    String Writing Functions
@@ -288,21 +816,29 @@ LIBSTRINGS unsigned int st_get_string(st_strings_handle sh, const uint32_t strin
 
 /* Replaces all existing strings in the file with the given strings. */
 LIBSTRINGS unsigned int st_set_strings(st_strings_handle sh, const st_string_data * strings, const size_t numStrings) {
+    LIBSTRINGS_TRACE("st_set_strings");
+
     if (sh == NULL || strings == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    boost::unordered_map<uint32_t, string> newMap;
+    handle_lock lock(sh, true);
+
+    string_index newMap;
 
     try {
         for (size_t i=0; i < numStrings; i++) {
-            if (!newMap.insert(pair<uint32_t, string>(strings[i].id, strings[i].data)).second)
+            //Check before storing the string, so that a rejected string doesn't take up space in the arena.
+            if (newMap.find(strings[i].id) != newMap.end())
                 return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The ID given for the string \"" + string(strings[i].data) + "\" already exists.");
+            newMap.insert(strings[i].id, sh->Store(strings[i].data));
         }
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
     } catch (error& e) {
         return c_error(e);
     }
 
-    sh->data = newMap;
+    sh->data.swap(newMap);
 
     return LIBSTRINGS_OK;
 }
@@ -312,8 +848,17 @@ LIBSTRINGS unsigned int st_add_string(st_strings_handle sh, const uint32_t strin
     if (sh == NULL || str == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    if (!sh->data.insert(pair<uint32_t, string>(stringId, str)).second)
-        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID already exists.");
+    handle_lock lock(sh, true);
+
+    try {
+        if (sh->data.find(stringId) != sh->data.end())
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID already exists.");
+        sh->data.insert(stringId, sh->Store(str));
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
 
     return LIBSTRINGS_OK;
 }
@@ -323,11 +868,19 @@ LIBSTRINGS unsigned int st_replace_string(st_strings_handle sh, const uint32_t s
     if (sh == NULL || newString == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    boost::unordered_map<uint32_t, string>::iterator it = sh->data.find(stringId);
-    if (it == sh->data.end())
-        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
+    handle_lock lock(sh, true);
+
+    try {
+        string_index::iterator it = sh->data.find(stringId);
+        if (it == sh->data.end())
+            return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
 
-    it->second = newString;
+        it->second = sh->Store(newString);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
 
     return LIBSTRINGS_OK;
 }
@@ -337,7 +890,9 @@ LIBSTRINGS unsigned int st_remove_string(st_strings_handle sh, const uint32_t st
     if (sh == NULL) //Check for valid args.
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
 
-    boost::unordered_map<uint32_t, string>::iterator it = sh->data.find(stringId);
+    handle_lock lock(sh, true);
+
+    string_index::iterator it = sh->data.find(stringId);
     if (it == sh->data.end())
         return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The given ID does not exist.");
 
@@ -345,3 +900,208 @@ LIBSTRINGS unsigned int st_remove_string(st_strings_handle sh, const uint32_t st
 
     return LIBSTRINGS_OK;
 }
+
+
+/*------------------------------
+   Asynchronous Functions
+------------------------------*/
+
+/* Starts opening a STRINGS, ILSTRINGS or DLSTRINGS file on a worker thread. */
+LIBSTRINGS unsigned int st_open_async(st_async_op * const op, const char * const path, const char * const fallbackEncoding, const bool mapFile, st_async_callback callback, void * const context) {
+    if (op == NULL || path == NULL || fallbackEncoding == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    InitLocale();
+
+    _strings_async_int * newOp = NULL;
+    try {
+        newOp = new _strings_async_int(callback, context);
+        RunAsync(boost::bind(&OpenTask, newOp, string(path), string(fallbackEncoding), mapFile));
+    } catch (bad_alloc& e) {
+        delete newOp;
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (boost::thread_resource_error& e) {
+        delete newOp;
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    }
+
+    *op = newOp;
+    return LIBSTRINGS_OK;
+}
+
+/* Copies the strings of the given handle, then starts saving them to the
+   given path on a worker thread. */
+LIBSTRINGS unsigned int st_save_async(st_async_op * const op, st_strings_handle sh, const char * const path, const char * const encoding, st_async_callback callback, void * const context) {
+    if (op == NULL || sh == NULL || path == NULL || encoding == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    handle_lock lock(sh, true);
+
+    _strings_handle_int * snapshot = NULL;
+    _strings_async_int * newOp = NULL;
+    try {
+        boost::system::error_code ec;
+        if (!sh->sourcePath.empty() && boost::filesystem::equivalent(path, sh->sourcePath, ec)) {
+            //Overwriting a mapped file would pull the strings out from under the handle.
+            if (sh->source.is_mapped())
+                sh->Detach();
+            //The handle's data block is about to be forgotten, so look for its unreferenced strings while it is still known.
+            sh->FindUnreferenced();
+            //Only the snapshot learns where the strings end up in the file, so the handle can't patch it any more.
+            sh->startOfData = 0;
+            sh->sourceHead.clear();
+        }
+
+        snapshot = new _strings_handle_int(*sh);
+        newOp = new _strings_async_int(callback, context);
+        RunAsync(boost::bind(&SaveTask, newOp, snapshot, string(path), string(encoding)));
+    } catch (bad_alloc& e) {
+        delete newOp;
+        delete snapshot;
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (boost::thread_resource_error& e) {
+        delete newOp;
+        delete snapshot;
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        delete newOp;
+        delete snapshot;
+        return c_error(e);
+    }
+
+    *op = newOp;
+    return LIBSTRINGS_OK;
+}
+
+/* Outputs whether the given operation has finished. */
+LIBSTRINGS unsigned int st_async_poll(st_async_op op, bool * const done) {
+    if (op == NULL || done == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    *done = op->IsDone();
+
+    return LIBSTRINGS_OK;
+}
+
+/* Waits for the given operation to finish. */
+LIBSTRINGS unsigned int st_async_wait(st_async_op op) {
+    if (op == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    op->Wait();
+
+    return LIBSTRINGS_OK;
+}
+
+/* Requests that the given operation be cancelled. */
+LIBSTRINGS unsigned int st_async_cancel(st_async_op op) {
+    if (op == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    op->cancel.set();
+
+    return LIBSTRINGS_OK;
+}
+
+/* Outputs the result of the given finished operation. */
+LIBSTRINGS unsigned int st_async_get_result(st_async_op op, unsigned int * const code, const char ** const message, st_strings_handle * const sh) {
+    if (op == NULL || code == NULL || message == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    //If the client doesn't want the handle, leave it to be closed with the operation.
+    if (!op->GetResult(*code, *message, sh))
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "The operation has not finished.");
+
+    return LIBSTRINGS_OK;
+}
+
+/* Cancels the given operation if it hasn't finished, waits for it, then
+   destroys it. */
+LIBSTRINGS void st_async_free(st_async_op op) {
+    if (op == NULL)
+        return;
+
+    op->cancel.set();
+    op->Wait();
+    delete op;
+}
+
+/* Waits for all started operations, then stops the worker threads. */
+LIBSTRINGS unsigned int st_async_shutdown() {
+    try {
+        StopAsync();
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+
+/*------------------------------
+   Statistics Functions
+------------------------------*/
+
+/* Sets whether handles collect statistics. */
+LIBSTRINGS void st_set_stats_enabled(const bool enabled) {
+    statsEnabled = enabled;
+}
+
+/* Outputs the statistics collected by the given handle. */
+LIBSTRINGS unsigned int st_get_stats(st_strings_handle sh, st_stats * const stats) {
+    if (sh == NULL || stats == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    handle_lock lock(sh, false);
+
+    *stats = sh->stats;
+
+    return LIBSTRINGS_OK;
+}
+
+
+/*------------------------------
+   Tracing Functions
+------------------------------*/
+
+/* Registers a callback that is called at the start and end of each traced
+   span, replacing any existing tracer. */
+LIBSTRINGS unsigned int st_set_trace_callback(st_trace_callback callback, void * const context) {
+    try {
+        StopTraceFile();
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    SetTracer(callback, context);
+
+    return LIBSTRINGS_OK;
+}
+
+/* Starts recording traced spans, to be written to the given path as a
+   Chrome trace event JSON file. */
+LIBSTRINGS unsigned int st_start_trace_file(const char * const path) {
+    if (path == NULL) //Check for valid args.
+        return c_error(LIBSTRINGS_ERROR_INVALID_ARGS, "Null pointer passed.");
+
+    try {
+        StartTraceFile(path);
+    } catch (bad_alloc& e) {
+        return c_error(LIBSTRINGS_ERROR_NO_MEM, e.what());
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
+
+/* Stops recording traced spans and writes them to the trace file. */
+LIBSTRINGS unsigned int st_stop_trace_file() {
+    try {
+        StopTraceFile();
+    } catch (error& e) {
+        return c_error(e);
+    }
+
+    return LIBSTRINGS_OK;
+}
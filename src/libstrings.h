@@ -25,7 +25,7 @@
     @file libstrings.h
     @brief This file contains the API frontend.
 
-    @note libstrings is *not* thread safe. Thread safety is a goal, but one that has not yet been achieved. Bear this in mind if using it in a multi-threaded client.
+    @note A handle must only be used by one thread at a time, unless it has been put into concurrent mode using st_set_concurrent(). Different handles can be used by different threads at once, and each thread has its own error message.
 
     @section var_sec Variable Types
 
@@ -41,7 +41,7 @@
 
     Data returned by a function lasts until a function is called which returns data of the same type (eg. a string is stored until the client calls another function which returns a string, an integer array lasts until another integer array is returned, etc.).
 
-    All allocated memory is freed when st_close() is called, except the string allocated by st_get_error_message(), which must be freed by calling st_cleanup().
+    All allocated memory is freed when st_close() is called, except the error message output by st_get_error_message() and the strings output for handles in concurrent mode, which are held by each thread and must be freed by the thread calling st_cleanup().
 */
 
 #ifndef __LIBSTRINGS_H__
@@ -92,10 +92,28 @@ extern "C"
 
 /**
     @brief A structure that holds all game-specific data used by libstrings.
-    @details Used to keep each strings file's data independent. Abstracts the definition of libstrings' internal state while still providing type safety across the library's functions. Multiple handles can also be made for each strings file, though it should be kept in mind that libstrings is not thread-safe.
+    @details Used to keep each strings file's data independent. Abstracts the definition of libstrings' internal state while still providing type safety across the library's functions. Multiple handles can also be made for each strings file. Different handles can be used by different threads at once, but a handle can only be used by several threads at once if it is in concurrent mode (see st_set_concurrent()).
 */
 typedef struct _strings_handle_int * st_strings_handle;
 
+/**
+    @brief A cursor over the strings associated with a handle.
+    @details Created by st_iter_begin() and destroyed by st_iter_end(). A cursor visits the strings that had IDs when it was created, skipping any that have since been removed. Strings added after the cursor was created are not visited.
+*/
+typedef struct _strings_iter_int * st_strings_iter;
+
+/**
+    @brief The STRINGS, DLSTRINGS and ILSTRINGS files of a plugin, opened together.
+    @details Created by st_bundle_open() and destroyed by st_bundle_close(). A bundle holds a handle for each of its files, which can be got using st_bundle_get_handle().
+*/
+typedef struct _strings_bundle_int * st_strings_bundle;
+
+/**
+    @brief A set of strings files loaded together.
+    @details Created by st_collection_open_dir() or st_collection_open_paths() and destroyed by st_collection_close(). A collection holds a handle for each file that was loaded, and the error for each file that couldn't be, which can be got using st_collection_get_entry().
+*/
+typedef struct _strings_collection_int * st_strings_collection;
+
 /**
     @brief A structure holding the ID and corresponding data of a string.
     @details Used by st_get_strings() and st_set_strings() to ensure IDs and string data don't get mixed up.
@@ -105,6 +123,63 @@ typedef struct {
         char * data;
 } st_string_data;
 
+/**
+    @brief A structure holding a view of a string in a handle's own storage.
+    @details Used by st_get_strings_by_ids() to output strings without copying them. The string data is null-terminated, and remains valid for as long as a view given by st_get_string_view() would.
+*/
+typedef struct {
+        const char * data;
+        size_t length;
+        bool found;
+} st_string_view;
+
+/**
+    @brief Statistics on the work done by a handle.
+    @details Used by st_get_stats(). Counts and times are totals for the life of the handle, and are only collected while statistics are enabled using st_set_stats_enabled(). Times are in nanoseconds.
+*/
+typedef struct {
+        uint64_t bytesRead;  ///< The size of the file read when opening the handle.
+        uint64_t bytesWritten;  ///< The number of bytes written when saving.
+        uint64_t entries;  ///< The number of directory entries read when opening the handle.
+        uint64_t unreferencedStrings;  ///< The number of strings without IDs found in the file read.
+        uint64_t stringsTranscoded;  ///< The number of strings decoded that had to be transcoded from the fallback encoding.
+        uint64_t stringsPassedThrough;  ///< The number of strings decoded that were already valid UTF-8.
+        uint64_t stringsSaved;  ///< The number of directory entries saved.
+        uint64_t uniqueStringsSaved;  ///< The number of distinct strings written when saving, which is less than the number of entries saved if some strings were deduplicated.
+        uint64_t readTime;  ///< The time spent reading or mapping the file when opening the handle.
+        uint64_t parseTime;  ///< The time spent reading the file's directory and finding its strings when opening the handle, including any decoding done by st_open_ex().
+        uint64_t decodeTime;  ///< The time spent validating strings as UTF-8 and transcoding them from the fallback encoding.
+        uint64_t scanTime;  ///< The time spent scanning the file for strings without IDs.
+        uint64_t dedupeTime;  ///< The time spent finding the distinct strings to write when saving, including decoding any strings that hadn't been already.
+        uint64_t encodeTime;  ///< The time spent encoding strings when saving.
+        uint64_t layoutTime;  ///< The time spent giving strings their offsets and copying them into place when saving.
+        uint64_t writeTime;  ///< The time spent writing files when saving.
+} st_stats;
+
+/**
+    @brief An open or save running in the background.
+    @details Created by st_open_async() or st_save_async() and destroyed by st_async_free().
+*/
+typedef struct _strings_async_int * st_async_op;
+
+/**
+    @brief A function called when an asynchronous operation finishes.
+    @details Called on one of the library's worker threads. The callback can get the operation's result using st_async_get_result(), but must not wait for or free the operation.
+    @param op The operation that finished.
+    @param code The operation's return code.
+    @param context The context given when the operation was started.
+*/
+typedef void (*st_async_callback)(st_async_op op, const unsigned int code, void * context);
+
+/**
+    @brief A function called at the start and end of each span of work traced by the library.
+    @details Registered using st_set_trace_callback(). Spans are the library functions that act on many strings or on files, and the phases of opening and saving files. Spans on the same thread are properly nested, but spans may be traced on several threads at once, including threads created by the library.
+    @param name The name of the span, which is a string literal that is valid for the life of the library.
+    @param begin `true` at the start of the span, and `false` at its end.
+    @param context The context given when the callback was registered.
+*/
+typedef void (*st_trace_callback)(const char * name, const bool begin, void * context);
+
 /*********************//**
     @name Return Codes
     @brief Error codes signify an issue that caused a function to exit prematurely. If a function exits prematurely, a reversal of any changes made during its execution is attempted before it exits.
@@ -117,6 +192,7 @@ LIBSTRINGS extern const unsigned int LIBSTRINGS_ERROR_NO_MEM;  ///< The library
 LIBSTRINGS extern const unsigned int LIBSTRINGS_ERROR_FILE_WRITE_FAIL;  ///< A file could not be written to.
 LIBSTRINGS extern const unsigned int LIBSTRINGS_ERROR_FILE_READ_FAIL;  ///< A file could not be read.
 LIBSTRINGS extern const unsigned int LIBSTRINGS_ERROR_BAD_STRING;  ///< A string provided contains invalid byte sequences.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_ERROR_CANCELLED;  ///< An asynchronous operation was cancelled before it completed.
 
 /**
     @brief Matches the value of the highest-numbered return code.
@@ -126,6 +202,41 @@ LIBSTRINGS extern const unsigned int LIBSTRINGS_RETURN_MAX;
 
 ///@}
 
+/*********************//**
+    @name Iteration Orders
+    @brief Used by st_iter_begin() to choose the order in which a cursor visits strings.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_ORDER_NONE;  ///< Strings are visited in an unspecified order, which is the fastest to set up.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_ORDER_ID;  ///< Strings are visited in ascending ID order.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_ORDER_OFFSET;  ///< Strings are visited in the order they appear in the file the handle was opened from, then any strings that have been added or replaced are visited in ascending ID order. Strings that share data are visited in ascending ID order.
+
+///@}
+
+/*********************//**
+    @name Save Options
+    @brief Used by st_save_ex() to change how files are saved. Options can be combined using bitwise OR.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_SAVE_MERGE_TAILS;  ///< When saving a STRINGS file, any string that ends another string is stored as part of it, making the file smaller. Has no effect when saving DLSTRINGS and ILSTRINGS files, as their strings are prefixed by their lengths and so cannot be shared in this way.
+
+///@}
+
+
+/*********************//**
+    @name File Types
+    @brief Used by st_open_from_memory() and st_save_to_memory() to give the format of a file held in memory, in place of the file extension used for files on disk.
+*************************/
+///@{
+
+LIBSTRINGS extern const unsigned int LIBSTRINGS_FILE_STRINGS;  ///< A STRINGS file.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_FILE_DLSTRINGS;  ///< A DLSTRINGS file.
+LIBSTRINGS extern const unsigned int LIBSTRINGS_FILE_ILSTRINGS;  ///< An ILSTRINGS file.
+
+///@}
+
 
 /**************************//**
     @name Version Functions
@@ -160,14 +271,14 @@ LIBSTRINGS void st_get_version(unsigned int * const versionMajor, unsigned int *
 
 /**
    @brief Returns the message for the last error or warning encountered.
-   @details Outputs a string giving the a message containing the details of the last error or warning encountered by a function. Each time this function is called, the memory for the previous message is freed, so only one error message is available at any one time.
+   @details Outputs a string giving the a message containing the details of the last error or warning encountered by a function called by the same thread. Each thread has its own message, which is replaced when the thread next encounters an error, so only one error message is available to a thread at any one time.
    @param details A pointer to the error details string outputted by the function.
    @returns A return code.
 */
 LIBSTRINGS unsigned int st_get_error_message(const char ** const details);
 
 /**
-   @brief Frees the memory allocated to the last error details string.
+   @brief Frees the memory allocated to the calling thread's last error details string, and to any strings output to it for handles in concurrent mode.
 */
 LIBSTRINGS void st_cleanup();
 
@@ -181,7 +292,7 @@ LIBSTRINGS void st_cleanup();
 
 /**
     @brief Initialise a new strings handle.
-    @details Opens a STRINGS, ILSTRINGS or DLSTRINGS file, outputting a handle for the strings it contains. If the file doesn't exist then a handle for a new file will be created. You can create multiple handles.
+    @details Opens a STRINGS, ILSTRINGS or DLSTRINGS file, outputting a handle for the strings it contains. If the file doesn't exist then a handle for a new file will be created. You can create multiple handles. Strings are only transcoded when they are first read, so a string that can't be decoded is reported by the function that reads it rather than by st_open().
     @param sh A pointer to the handle that is created by the function.
     @param path A string containing the relative or absolute path to the strings file to be opened. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
     @param fallbackEncoding The encoding that should be used to interpret any strings in the file that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
@@ -189,6 +300,40 @@ LIBSTRINGS void st_cleanup();
 */
 LIBSTRINGS unsigned int st_open(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding);
 
+/**
+    @brief Initialise a new strings handle by memory-mapping a file.
+    @details Behaves as st_open(), except that the file is mapped into memory read-only instead of being read. Strings that are already valid UTF-8 are not copied out of the mapping until they are modified, so opening a file takes time proportional to the size of its directory rather than the size of the file. The file must not be modified by other processes while the handle is open. Saving to the same path as the file was opened from is safe.
+    @param sh A pointer to the handle that is created by the function.
+    @param path A string containing the relative or absolute path to the strings file to be opened. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the file that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_open_mapped(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding);
+
+/**
+    @brief Initialise a new strings handle, reading the file using multiple threads.
+    @details Behaves as st_open(), except that the file's directory is split between the given number of threads, which read their share of the strings and transcode them in parallel. The resulting handle is the same as one created by st_open(), though its strings have already been transcoded. Small files are read using fewer threads than requested, as splitting them up wouldn't make reading any faster.
+    @param sh A pointer to the handle that is created by the function.
+    @param path A string containing the relative or absolute path to the strings file to be opened. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the file that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param threads The maximum number of threads to use. If `0`, the number of hardware threads available is used.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_open_ex(st_strings_handle * const sh, const char * const path, const char * const fallbackEncoding, const unsigned int threads);
+
+/**
+    @brief Initialise a new strings handle from a file held in memory.
+    @details Behaves as st_open(), except that the file's contents are read from the given buffer, and its format is given explicitly rather than by a file extension. Handles opened from memory cannot be saved using st_save_patch() or st_compact().
+    @param sh A pointer to the handle that is created by the function.
+    @param buffer The contents of the strings file.
+    @param size The size of the buffer in bytes.
+    @param fileType The format of the strings file. Must be one of the file type constants.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the file that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param borrow If `false`, the buffer is copied, and can be freed once the function returns. If `true`, the buffer is used in place and strings are not copied out of it until they are modified, so it must not be modified or freed until the handle is closed.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_open_from_memory(st_strings_handle * const sh, const uint8_t * const buffer, const size_t size, const unsigned int fileType, const char * const fallbackEncoding, const bool borrow);
+
 /**
     @brief Saves the strings associated with a handle.
     @details Saves the strings associated with the given handle to the given path, using the given encoding. Duplicate string entries are skipped, as are any unreferenced strings. If a file is loaded then saved by libstrings, the order of its contents may not match their order in the original file. This does not affect Skyrim's handling of the files, as the order does not matter.
@@ -199,6 +344,57 @@ LIBSTRINGS unsigned int st_open(st_strings_handle * const sh, const char * const
 */
 LIBSTRINGS unsigned int st_save(st_strings_handle sh, const char * const path, const char * const encoding);
 
+/**
+    @brief Saves the strings associated with a handle, encoding them using multiple threads and with the given options.
+    @details Behaves as st_save(), except that when saving in an encoding other than UTF-8, the strings are split between the given number of threads, which encode their share in parallel. If no options are given, the file saved is identical to that saved by st_save(). Handles with few strings are saved using fewer threads than requested, as splitting them up wouldn't make saving any faster.
+    @param sh The handle the function acts on.
+    @param path A string containing the relative or absolute path to the strings file to be saved to. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param encoding The encoding in which the strings should be written. Accepted values are `UTF-8`, `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param threads The maximum number of threads to use. If `0`, the number of hardware threads available is used.
+    @param options The save options to use, combined using bitwise OR, or `0` for none.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_save_ex(st_strings_handle sh, const char * const path, const char * const encoding, const unsigned int threads, const unsigned int options);
+
+/**
+    @brief Saves the strings associated with a handle to a buffer.
+    @details Outputs the contents of the file that st_save() would save, in the given format, without writing it to disk. The buffer is managed by the handle, and lasts until st_save_to_memory() is next called for the handle, or the handle is closed.
+    @param sh The handle the function acts on.
+    @param fileType The format of the file to save. Must be one of the file type constants.
+    @param encoding The encoding in which the strings should be written. Accepted values are `UTF-8`, `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param buffer The outputted file contents.
+    @param size The size of the outputted buffer in bytes.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_save_to_memory(st_strings_handle sh, const unsigned int fileType, const char * const encoding, const uint8_t ** const buffer, size_t * const size);
+
+/**
+    @brief Saves changes to the strings associated with a handle to the file it was opened from, in place.
+    @details Rather than rewriting the whole file, the header and directory are rewritten in place, and new and changed strings are appended to the end of the file. The rest of the file is left untouched, including the strings that changed strings have replaced, so the file grows with each patch until st_compact() is called. If strings have been added, the directory grows over the first few strings of the file, which are appended along with the new and changed strings. The whole file is rewritten instead if the handle now holds fewer strings than the file's directory does, if the grown directory would end part of the way through a string or past the end of the file, or if the file's size, last modification time, header or directory are not as the handle last read or wrote them. Other changes made to the file since the handle last read or wrote it are not detected.
+    @param sh The handle the function acts on.
+    @param encoding The encoding in which new and changed strings should be written. Strings that are left in place are not re-encoded. Accepted values are `UTF-8`, `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_save_patch(st_strings_handle sh, const char * const encoding);
+
+/**
+    @brief Rewrites the file that a handle was opened from, reclaiming unused space.
+    @details Saves the strings associated with the given handle to the file it was opened from, as st_save() does, dropping any strings that patch saves have left behind.
+    @param sh The handle the function acts on.
+    @param encoding The encoding in which the strings should be written. Accepted values are `UTF-8`, `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_compact(st_strings_handle sh, const char * const encoding);
+
+/**
+    @brief Sets whether a handle can be used by several threads at once.
+    @details By default, a handle must only be used by one thread at a time. In concurrent mode, any number of threads can read strings using a handle at the same time, while functions that change the handle or save its strings wait for exclusive use of it. All strings are decoded when concurrent mode is enabled, so that reading them doesn't change the handle. The strings output by st_get_string(), st_get_strings() and st_get_unref_strings() are held by the calling thread rather than the handle, so they are valid until the same function is next called by the same thread for any handle in concurrent mode, or until st_cleanup() is called by the thread. Strings output by other functions may be invalidated by another thread changing the handle. This function must not be called while other threads are using the handle.
+    @param sh The handle the function acts on.
+    @param concurrent Whether the handle should be in concurrent mode.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_set_concurrent(st_strings_handle sh, const bool concurrent);
+
 /**
     @brief Closes an existing handle.
     @details Closes an existing handle, freeing any memory allocated during its use.
@@ -209,6 +405,113 @@ LIBSTRINGS void st_close(st_strings_handle sh);
 ///@}
 
 
+/***************************************//**
+    @name Bundle Functions
+*******************************************/
+///@{
+
+/**
+    @brief Opens a plugin's strings files together.
+    @details A plugin's strings are split between three files with the same base path, e.g. `Strings/Skyrim_English.STRINGS`, `Strings/Skyrim_English.DLSTRINGS` and `Strings/Skyrim_English.ILSTRINGS`. This opens all three at once, reading them concurrently, and is otherwise equivalent to opening each file using st_open() or st_open_mapped(). If any of the files can't be opened, no bundle is created and the error for the first such file is returned.
+    @param bundle A pointer to the bundle that is created by the function.
+    @param basePath The relative or absolute path to the files to be opened, without their file extensions.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the files that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param mapFiles If `true`, the files are mapped into memory as by st_open_mapped(), otherwise they are read as by st_open().
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_bundle_open(st_strings_bundle * const bundle, const char * const basePath, const char * const fallbackEncoding, const bool mapFiles);
+
+/**
+    @brief Gets the handle for one of the files in a bundle.
+    @details The handle can be used with any of the functions that act on handles, except st_close(): it belongs to the bundle, and is valid until the bundle is closed. Handles for different files in a bundle are independent, so strings are identified by their file type and their ID.
+    @param bundle The bundle the function acts on.
+    @param fileType The file to get the handle for. Must be one of the file type constants.
+    @param sh The outputted handle.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_bundle_get_handle(st_strings_bundle bundle, const unsigned int fileType, st_strings_handle * const sh);
+
+/**
+    @brief Saves all the files in a bundle.
+    @details Saves each file as st_save() would, writing the three files concurrently. If any of the files can't be saved, the error for the first such file is returned, though the others may still have been saved.
+    @param bundle The bundle the function acts on.
+    @param basePath The relative or absolute path to the files to be saved, without their file extensions.
+    @param encoding The encoding in which the strings should be written. Accepted values are `UTF-8`, `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_bundle_save(st_strings_bundle bundle, const char * const basePath, const char * const encoding);
+
+/**
+    @brief Closes an existing bundle.
+    @details Closes the bundle and the handles for its files, freeing any memory allocated during their use.
+    @param bundle The bundle to be destroyed.
+*/
+LIBSTRINGS void st_bundle_close(st_strings_bundle bundle);
+
+///@}
+
+
+/***************************************//**
+    @name Collection Functions
+*******************************************/
+///@{
+
+/**
+    @brief Loads all the strings files in a directory.
+    @details Loads every file in the given directory that has a `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS` file extension, as st_collection_open_paths() would. Subdirectories are not searched.
+    @param collection A pointer to the collection that is created by the function.
+    @param path The relative or absolute path to the directory, e.g. `Data/Strings`.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the files that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param mapFiles If `true`, the files are mapped into memory as by st_open_mapped(), otherwise they are read as by st_open().
+    @param threads The number of threads to load files with. If `0`, the number of hardware threads is used.
+    @returns A return code. A file that can't be loaded doesn't cause the function to fail, but is given an error in the collection.
+*/
+LIBSTRINGS unsigned int st_collection_open_dir(st_strings_collection * const collection, const char * const path, const char * const fallbackEncoding, const bool mapFiles, const unsigned int threads);
+
+/**
+    @brief Loads the given strings files.
+    @details Opens each file as st_open() or st_open_mapped() would, except that a file which doesn't exist is given a `LIBSTRINGS_ERROR_FILE_READ_FAIL` error in the collection rather than a handle for a new file. The files are loaded using a pool of threads that each load the next file not yet taken by another, so that the load is spread evenly however much the files' sizes vary.
+    @param collection A pointer to the collection that is created by the function.
+    @param paths An array of paths to the files to be loaded. The collection's entries are in the same order.
+    @param numPaths The size of the array of paths.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the files that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param mapFiles If `true`, the files are mapped into memory as by st_open_mapped(), otherwise they are read as by st_open().
+    @param threads The number of threads to load files with. If `0`, the number of hardware threads is used.
+    @returns A return code. A file that can't be loaded doesn't cause the function to fail, but is given an error in the collection.
+*/
+LIBSTRINGS unsigned int st_collection_open_paths(st_strings_collection * const collection, const char * const * const paths, const size_t numPaths, const char * const fallbackEncoding, const bool mapFiles, const unsigned int threads);
+
+/**
+    @brief Gets the number of files in a collection.
+    @param collection The collection the function acts on.
+    @param numEntries The outputted number of files, including those that couldn't be loaded.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_collection_get_size(st_strings_collection collection, size_t * const numEntries);
+
+/**
+    @brief Gets a file in a collection.
+    @details The outputted handle can be used with any of the functions that act on handles, except st_close(): it belongs to the collection, and is valid until the collection is closed. The outputted path and error message are also valid until the collection is closed.
+    @param collection The collection the function acts on.
+    @param index The index of the file, which must be less than the collection's size.
+    @param path The outputted path of the file.
+    @param sh The outputted handle for the file, or `NULL` if it couldn't be loaded.
+    @param code The outputted return code given when loading the file.
+    @param message The outputted error message given when loading the file, or `NULL` if it was loaded successfully.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_collection_get_entry(st_strings_collection collection, const size_t index, const char ** const path, st_strings_handle * const sh, unsigned int * const code, const char ** const message);
+
+/**
+    @brief Closes an existing collection.
+    @details Closes the collection and the handles for its files, freeing any memory allocated during their use.
+    @param collection The collection to be destroyed.
+*/
+LIBSTRINGS void st_collection_close(st_strings_collection collection);
+
+///@}
+
+
 /***************************************//**
     @name String Reading Functions
 *******************************************/
@@ -225,6 +528,7 @@ LIBSTRINGS unsigned int st_get_strings(st_strings_handle sh, st_string_data ** c
 
 /**
     @brief Gets an array any strings that are associated with the given handle but lack IDs.
+    @details The strings file is only searched for unreferenced strings the first time this function is called for the given handle, so handles that never call it don't pay for the search.
     @param sh The handle the function acts on.
     @param strings The outputted array of strings. If numStrings is `0`, this will be `NULL`.
     @param numStrings The size of the outputted array.
@@ -242,6 +546,55 @@ LIBSTRINGS unsigned int st_get_unref_strings(st_strings_handle sh, char *** cons
 */
 LIBSTRINGS unsigned int st_get_string(st_strings_handle sh, const uint32_t stringId, char ** const string);
 
+/**
+    @brief Gets a view of the string with the given ID, without copying it.
+    @details Outputs a pointer to the string with the given ID in the handle's own storage, along with its length in bytes. Unlike st_get_string(), no memory is allocated, and the views from any number of calls can be held at once. The string is null-terminated. A view remains valid until the string it is of is replaced or removed, or the handle is closed. All views of a handle's strings are invalidated by calling st_set_strings(), st_save(), st_save_ex(), st_save_patch() or st_compact() for the handle, st_bundle_save() for a bundle it belongs to, or st_save_async() for it if it was opened using st_open_mapped() and its own file is being saved over. If no string is found with that ID, the function returns an error code.
+    @param sh The handle the function acts on.
+    @param stringId The ID for which to return the associated string.
+    @param string The outputted string. If no string with the given ID is found, this will be `NULL`.
+    @param length The length of the outputted string in bytes, not including its null terminator.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_string_view(st_strings_handle sh, const uint32_t stringId, const char ** const string, size_t * const length);
+
+/**
+    @brief Gets views of the strings with the given IDs, without copying them.
+    @details Looks up each of the given IDs, outputting a view of its string into the element of the results array at the same index. IDs that have no string associated with them are not an error: their results have `found` set to `false`, `data` set to `NULL` and `length` set to `0`. Looking up many IDs with one call is faster than calling st_get_string_view() for each.
+    @param sh The handle the function acts on.
+    @param stringIds The array of IDs to look up.
+    @param numIds The size of the IDs array.
+    @param results A client-allocated array of at least `numIds` elements, which the views are outputted into.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_strings_by_ids(st_strings_handle sh, const uint32_t * const stringIds, const size_t numIds, st_string_view * const results);
+
+/**
+    @brief Creates a cursor over the strings with assigned IDs, that are associated with the given handle.
+    @details Unlike st_get_strings(), a cursor does not copy the strings, and only allocates memory for their IDs. The cursor must be destroyed using st_iter_end() before the handle is closed.
+    @param sh The handle the function acts on.
+    @param iter The outputted cursor.
+    @param order The order in which to visit the strings. Must be one of the iteration order constants.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_iter_begin(st_strings_handle sh, st_strings_iter * const iter, const unsigned int order);
+
+/**
+    @brief Gets the next string visited by a cursor, without copying it.
+    @details The string outputted remains valid for as long as a view given by st_get_string_view() would.
+    @param iter The cursor the function acts on.
+    @param stringId The outputted ID of the string. If there are no strings left to visit, this will be `0`.
+    @param string The outputted string. If there are no strings left to visit, this will be `NULL`.
+    @param length The length of the outputted string in bytes, not including its null terminator.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_iter_next(st_strings_iter iter, uint32_t * const stringId, const char ** const string, size_t * const length);
+
+/**
+    @brief Destroys a cursor, freeing any memory allocated during its use.
+    @param iter The cursor to destroy.
+*/
+LIBSTRINGS void st_iter_end(st_strings_iter iter);
+
 ///@}
 
 
@@ -291,6 +644,144 @@ LIBSTRINGS unsigned int st_remove_string(st_strings_handle sh, const uint32_t st
 
 ///@}
 
+
+/***************************************//**
+    @name Asynchronous Functions
+    @brief Opens and saves can be run on a set of worker threads that the library starts when first needed and st_async_shutdown() stops, so that they don't block the calling thread. Each operation's completion can be waited for, polled, or reported through a callback.
+*******************************************/
+///@{
+
+/**
+    @brief Opens a strings file in the background.
+    @details Behaves as st_open() or st_open_mapped(), but returns once the operation has been started. The handle opened is got using st_async_get_result().
+    @param op A pointer to the operation that is created by the function.
+    @param path A string containing the relative or absolute path to the strings file to be opened. The file extension must be one of `.STRINGS`, `.DLSTRINGS` or `.ILSTRINGS`.
+    @param fallbackEncoding The encoding that should be used to interpret any strings in the file that are not valid UTF-8 strings. Accepted values are `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param mapFile If `true`, the file is mapped into memory as by st_open_mapped(), otherwise it is read as by st_open().
+    @param callback The function to call when the operation finishes, or `NULL`.
+    @param context A pointer that is passed to the callback.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_open_async(st_async_op * const op, const char * const path, const char * const fallbackEncoding, const bool mapFile, st_async_callback callback, void * const context);
+
+/**
+    @brief Saves the strings associated with a handle in the background.
+    @details Behaves as st_save(), but returns once the strings to save have been copied from the handle, so the handle can be used and changed while the file is written. If the file being saved over is the one the handle was opened from, the next st_save_patch() for the handle rewrites the whole file, and if the file is mapped into memory, the handle's strings are first copied out of it, as by st_save().
+    @param op A pointer to the operation that is created by the function.
+    @param sh The handle the function acts on.
+    @param path The path to which the file should be saved.
+    @param encoding The encoding in which the strings should be written. Accepted values are `UTF-8`, `Windows-1250`, `Windows-1251` and `Windows-1252`.
+    @param callback The function to call when the operation finishes, or `NULL`.
+    @param context A pointer that is passed to the callback.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_save_async(st_async_op * const op, st_strings_handle sh, const char * const path, const char * const encoding, st_async_callback callback, void * const context);
+
+/**
+    @brief Checks whether an asynchronous operation has finished.
+    @param op The operation the function acts on.
+    @param done The outputted state of the operation, which is `true` once it has finished and its callback has returned.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_async_poll(st_async_op op, bool * const done);
+
+/**
+    @brief Waits for an asynchronous operation to finish.
+    @param op The operation the function acts on.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_async_wait(st_async_op op);
+
+/**
+    @brief Requests that an asynchronous operation be cancelled.
+    @details An operation that hasn't started yet doesn't run. A save that has started stops before it writes to its file, and an open that has started finishes but closes the handle it opened. In each case, the operation's return code is `LIBSTRINGS_ERROR_CANCELLED`. An operation that has already finished is unaffected.
+    @param op The operation the function acts on.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_async_cancel(st_async_op op);
+
+/**
+    @brief Gets the result of an asynchronous operation.
+    @param op The operation the function acts on.
+    @param code The outputted return code of the operation.
+    @param message The outputted error message of the operation, or `NULL` if it succeeded. It is valid until the operation is freed.
+    @param sh The outputted handle opened by st_open_async(), or `NULL` if the operation was a save, failed, or the handle has already been output. Once output, the handle belongs to the client and must be closed using st_close(). Can be `NULL` if no handle is wanted yet, in which case the handle is kept for a later call to output, or to be closed by st_async_free().
+    @returns A return code. Returns `LIBSTRINGS_ERROR_INVALID_ARGS` if the operation hasn't finished.
+*/
+LIBSTRINGS unsigned int st_async_get_result(st_async_op op, unsigned int * const code, const char ** const message, st_strings_handle * const sh);
+
+/**
+    @brief Frees an asynchronous operation.
+    @details If the operation hasn't finished, it is cancelled and the function waits for it to finish. Any handle it opened that hasn't been output by st_async_get_result() is closed.
+    @param op The operation to be destroyed.
+*/
+LIBSTRINGS void st_async_free(st_async_op op);
+
+/**
+    @brief Stops the library's worker threads.
+    @details Waits for all operations that have been started to finish, then stops the threads that run them. The threads are not stopped when the library is unloaded or the process exits, so this must be called first if asynchronous operations have been used: otherwise, operations that haven't finished may not run to completion. Operations started after this is called start the worker threads again.
+    @returns A return code. Returns `LIBSTRINGS_ERROR_INVALID_ARGS` if called from an operation's callback.
+*/
+LIBSTRINGS unsigned int st_async_shutdown();
+
+///@}
+
+
+/***************************************//**
+    @name Statistics Functions
+*******************************************/
+///@{
+
+/**
+    @brief Sets whether handles collect statistics on the work they do.
+    @details Statistics are not collected by default. Collecting them adds a small amount of time to each phase of opening and saving a handle, and to decoding each string, which is negligible when they are disabled. Enabling statistics before opening a handle allows the time spent opening it to be measured. This function must not be called while other threads are using the library.
+    @param enabled Whether statistics should be collected.
+*/
+LIBSTRINGS void st_set_stats_enabled(const bool enabled);
+
+/**
+    @brief Gets the statistics collected by a handle.
+    @param sh The handle the function acts on.
+    @param stats A pointer to a client-allocated structure that the statistics are outputted into.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_get_stats(st_strings_handle sh, st_stats * const stats);
+
+///@}
+
+
+/***************************************//**
+    @name Tracing Functions
+    @brief Tracing lets clients see when the library's work happens, alongside their own. When no tracer is registered, tracing costs a check for one at the start of each span, and it can be compiled out completely by building the library with `LIBSTRINGS_NO_TRACE` defined. These functions can be called while other threads are using the library: spans that have already started are reported to the tracer they started with, so a callback's context must stay valid until the spans using it have ended.
+*******************************************/
+///@{
+
+/**
+    @brief Registers a tracing callback.
+    @details Replaces any existing tracer. If a trace file was being recorded, it is written out first.
+    @param callback The function to call at the start and end of each span, or `NULL` to stop tracing.
+    @param context A pointer that is passed to the callback.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_set_trace_callback(st_trace_callback callback, void * const context);
+
+/**
+    @brief Starts recording a trace file.
+    @details Registers a tracer that records each span with the time and thread it happened on, replacing any existing tracer. The recording is written out by st_stop_trace_file() as a JSON file in the Chrome trace event format, which can be viewed using `chrome://tracing` or other trace viewers. Events that can't be recorded because memory runs out are dropped, and their number is written to the file as `droppedEvents` in its `otherData`.
+    @param path The relative or absolute path to write the trace file to.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_start_trace_file(const char * const path);
+
+/**
+    @brief Stops recording a trace file, and writes it out.
+    @details Does nothing if no trace file is being recorded. Spans still open on other threads are written without their ends.
+    @returns A return code.
+*/
+LIBSTRINGS unsigned int st_stop_trace_file();
+
+///@}
+
 #ifdef __cplusplus
 }
 #endif
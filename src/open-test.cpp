@@ -0,0 +1,479 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/* Writes files byte by byte and opens them through the library's API, to
+   check that the ways of opening files that read them differently to a
+   plain st_open() give the same strings.
+   Usage: libstrings-open-test [directory]
+   The files are written to the given directory, or the working directory
+   if none is given. Exits with a non-zero status if any check fails. */
+
+#include "libstrings.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+
+namespace {
+    struct test_state {
+        test_state() : checks(0), failures(0) {}
+
+        size_t checks;
+        size_t failures;
+        string dir;
+    };
+
+    void check(test_state& state, const bool passed, const char * test, const char * what) {
+        state.checks++;
+        if (!passed) {
+            state.failures++;
+            printf("FAILED: %s: %s\n", test, what);
+        }
+    }
+
+    bool check_code(test_state& state, const unsigned int code, const char * test, const char * what) {
+        check(state, code == LIBSTRINGS_OK, test, what);
+        if (code != LIBSTRINGS_OK) {
+            const char * details = NULL;
+            st_get_error_message(&details);
+            printf("    error %u: %s\n", code, details == NULL ? "" : details);
+        }
+        return code == LIBSTRINGS_OK;
+    }
+
+    string file_path(const test_state& state, const char * name) {
+        return state.dir + "/" + name;
+    }
+
+    string read_file(const string& path) {
+        ifstream in(path.c_str(), ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    void write_file(const string& path, const string& contents) {
+        ofstream out(path.c_str(), ios::binary | ios::trunc);
+        out.write(contents.data(), contents.size());
+    }
+
+    bool contains(const string& haystack, const string& needle) {
+        return haystack.find(needle) != string::npos;
+    }
+
+    void put_uint32(string& out, const uint32_t value) {
+        for (size_t i=0; i < 4; i++)
+            out += (char)((value >> (8 * i)) & 0xFF);
+    }
+
+    //A file's directory and data block, built up an entry at a time.
+    struct file_builder {
+        file_builder() : count(0) {}
+
+        //Adds a length-prefixed string to the data block, returning its offset.
+        uint32_t add_data(const string& str) {
+            return add_data_with_prefix(str, (uint32_t)str.length() + 1);
+        }
+
+        //Adds a string with the given prefix, whether or not it is the string's length.
+        uint32_t add_data_with_prefix(const string& str, const uint32_t prefix) {
+            string bytes;
+            put_uint32(bytes, prefix);
+            return add_raw(bytes + str + '\0');
+        }
+
+        //Adds a null-terminated string without a prefix, as STRINGS files hold them.
+        uint32_t add_terminated(const string& str) {
+            return add_raw(str + '\0');
+        }
+
+        uint32_t add_raw(const string& bytes) {
+            const uint32_t offset = (uint32_t)data.size();
+            data += bytes;
+            return offset;
+        }
+
+        void add_entry(const uint32_t id, const uint32_t offset) {
+            put_uint32(directory, id);
+            put_uint32(directory, offset);
+            count++;
+        }
+
+        string str() const {
+            string file;
+            put_uint32(file, count);
+            put_uint32(file, (uint32_t)data.size());
+            return file + directory + data;
+        }
+
+        uint32_t count;
+        string directory;
+        string data;
+    };
+
+    //xorshift64*, so that runs are repeatable across platforms.
+    class random_source {
+    public:
+        random_source(const uint64_t seed) : _state(seed == 0 ? 1 : seed) {}
+
+        uint32_t next() {
+            _state ^= _state >> 12;
+            _state ^= _state << 25;
+            _state ^= _state >> 27;
+            return (uint32_t)((_state * 2685821657736338717ULL) >> 32);
+        }
+
+        uint32_t below(const uint32_t n) { return next() % n; }
+    private:
+        uint64_t _state;
+    };
+
+    //Everything the C API reports about a handle's strings, for comparing handles.
+    struct handle_contents {
+        vector<unsigned int> codes;
+        vector<string> strings;
+        vector<string> unreferenced;
+
+        bool operator == (const handle_contents& other) const {
+            return codes == other.codes && strings == other.strings && unreferenced == other.unreferenced;
+        }
+    };
+
+    handle_contents get_contents(test_state& state, st_strings_handle sh, const set<uint32_t>& ids, const char * test) {
+        handle_contents contents;
+        for (set<uint32_t>::const_iterator it=ids.begin(), endIt=ids.end(); it != endIt; ++it) {
+            char * str = NULL;
+            contents.codes.push_back(st_get_string(sh, *it, &str));
+            contents.strings.push_back(str == NULL ? "" : str);
+        }
+
+        char ** unref = NULL;
+        size_t count = 0;
+        if (check_code(state, st_get_unref_strings(sh, &unref, &count), test, "getting unreferenced strings")) {
+            for (size_t i=0; i < count; i++)
+                contents.unreferenced.push_back(unref[i]);
+        }
+        return contents;
+    }
+
+    //A file big enough to be read in several chunks, with duplicate IDs, shared strings, strings that need transcoding and strings that can't be decoded.
+    void test_open_ex(test_state& state) {
+        const char * test = "multi-threaded open";
+        const string path = file_path(state, "open-test-threads.ILSTRINGS");
+        const string serialPath = file_path(state, "open-test-threads-serial.ILSTRINGS");
+        const string parallelPath = file_path(state, "open-test-threads-parallel.ILSTRINGS");
+
+        random_source random(1);
+        file_builder file;
+        set<uint32_t> ids;
+        vector<uint32_t> offsets;
+        for (uint32_t i=0; i < 20000; i++) {
+            const uint32_t id = random.below(8) == 0 && !ids.empty() ? 1 + random.below(i) : 1 + i;
+            ids.insert(id);
+
+            if (random.below(10) == 0 && !offsets.empty()) {
+                file.add_entry(id, offsets[random.below((uint32_t)offsets.size())]);
+                continue;
+            }
+
+            char str[32];
+            sprintf(str, "String %u", (unsigned int)i);
+            string value = str;
+            switch (random.below(10)) {
+            case 0:
+                value += " caf\xE9";
+                break;
+            case 1:
+                value += " \x81";
+                break;
+            case 2:
+                value += " caf\xC3\xA9";
+                break;
+            default:
+                break;
+            }
+            offsets.push_back(file.add_data(value));
+            file.add_entry(id, offsets.back());
+            if (random.below(50) == 0)
+                file.add_data(string("Orphan ") + str);
+        }
+        write_file(path, file.str());
+
+        st_strings_handle serial = NULL, parallel = NULL;
+        if (!check_code(state, st_open(&serial, path.c_str(), "Windows-1252"), test, "opening the file using st_open()"))
+            return;
+        if (!check_code(state, st_open_ex(&parallel, path.c_str(), "Windows-1252", 4), test, "opening the file using several threads")) {
+            st_close(serial);
+            return;
+        }
+
+        const handle_contents serialContents = get_contents(state, serial, ids, test);
+        check(state, serialContents == get_contents(state, parallel, ids, test), test, "the strings read using several threads differ from those read by st_open()");
+
+        check_code(state, st_save(serial, serialPath.c_str(), "Windows-1252"), test, "saving the file read by st_open()");
+        check_code(state, st_save(parallel, parallelPath.c_str(), "Windows-1252"), test, "saving the file read using several threads");
+        check(state, read_file(serialPath) == read_file(parallelPath), test, "the file read using several threads was saved differently");
+        st_close(serial);
+        st_close(parallel);
+    }
+
+    //Prefixes that can't be trusted are ignored in favour of the null terminator, when reading strings and when scanning for unreferenced ones.
+    void test_bad_prefixes(test_state& state, const bool mapFile) {
+        const char * test = mapFile ? "bad prefixes in a mapped file" : "bad prefixes";
+        const string path = file_path(state, "open-test-prefixes.DLSTRINGS");
+
+        file_builder file;
+        file.add_entry(1, file.add_data_with_prefix("Oversized", 0xFFFF));
+        file.add_entry(2, file.add_data_with_prefix("Zero", 0));
+        file.add_entry(3, file.add_data_with_prefix("Short", 3));
+        //This prefix runs on to the end of the next string, so it is trusted and the string includes the next one after its terminator.
+        const string overlap = "Overlap";
+        const string next = "Next";
+        file.add_entry(4, file.add_data_with_prefix(overlap, (uint32_t)(overlap.length() + 1 + sizeof(uint32_t) + next.length() + 1)));
+        file.add_entry(5, file.add_data(next));
+        file.add_data("Orphan");
+        file.add_data_with_prefix("Zero-prefixed orphan", 0);
+        file.add_entry(6, file.add_data("Last"));
+        //An incomplete prefix at the end of the data block is ignored.
+        file.add_raw(string("\x02\x00", 2));
+        write_file(path, file.str());
+
+        const char * expected[] = { "Oversized", "Zero", "Short", "Overlap", "Next", "Last" };
+        set<string> expectedUnref;
+        expectedUnref.insert("Orphan");
+        expectedUnref.insert("Zero-prefixed orphan");
+
+        st_strings_handle sh = NULL;
+        const unsigned int code = mapFile ? st_open_mapped(&sh, path.c_str(), "Windows-1252") : st_open(&sh, path.c_str(), "Windows-1252");
+        if (!check_code(state, code, test, "opening the file"))
+            return;
+
+        for (uint32_t id=1; id <= 6; id++) {
+            char * str = NULL;
+            if (check_code(state, st_get_string(sh, id, &str), test, "getting a string"))
+                check(state, string(str) == expected[id - 1], test, "a string read differs from that in the file");
+        }
+
+        char ** unref = NULL;
+        size_t count = 0;
+        if (check_code(state, st_get_unref_strings(sh, &unref, &count), test, "getting unreferenced strings")) {
+            set<string> found;
+            for (size_t i=0; i < count; i++)
+                found.insert(unref[i]);
+            check(state, count == expectedUnref.size() && found == expectedUnref, test, "the unreferenced strings found differ from those in the file");
+        }
+        st_close(sh);
+    }
+
+    //Writes a file with one string, prefixed or not as the file's extension requires.
+    void write_string_file(const string& path, const uint32_t id, const string& str) {
+        file_builder file;
+        const bool prefixed = !contains(path, ".STRINGS");
+        file.add_entry(id, prefixed ? file.add_data(str) : file.add_terminated(str));
+        write_file(path, file.str());
+    }
+
+    //A header for more directory entries than the file holds.
+    void write_corrupt_file(const string& path) {
+        string file;
+        put_uint32(file, 100);
+        put_uint32(file, 0);
+        write_file(path, file);
+    }
+
+    bool check_string(test_state& state, st_strings_handle sh, const uint32_t id, const string& expected, const char * test, const char * what) {
+        char * str = NULL;
+        if (!check_code(state, st_get_string(sh, id, &str), test, "getting a string"))
+            return false;
+        check(state, string(str) == expected, test, what);
+        return true;
+    }
+
+    size_t count_strings(test_state& state, st_strings_handle sh, const char * test) {
+        st_string_data * strings = NULL;
+        size_t count = 0;
+        check_code(state, st_get_strings(sh, &strings, &count), test, "getting strings");
+        return count;
+    }
+
+    const unsigned int bundleTypes[] = { LIBSTRINGS_FILE_STRINGS, LIBSTRINGS_FILE_DLSTRINGS, LIBSTRINGS_FILE_ILSTRINGS };
+    const char * const bundleExtensions[] = { ".STRINGS", ".DLSTRINGS", ".ILSTRINGS" };
+    const char * const bundleStrings[] = { "Name", "Description", "Line" };
+
+    void write_bundle(const string& basePath) {
+        for (size_t i=0; i < 3; i++)
+            write_string_file(basePath + bundleExtensions[i], 1, bundleStrings[i]);
+    }
+
+    void test_bundle(test_state& state, const bool mapFiles) {
+        const char * test = mapFiles ? "mapped bundle" : "bundle";
+        const string basePath = file_path(state, "open-test-bundle");
+        const string savedPath = file_path(state, "open-test-bundle-saved");
+        write_bundle(basePath);
+
+        //Each file's strings are in its own handle, though they share IDs.
+        st_strings_bundle bundle = NULL;
+        if (!check_code(state, st_bundle_open(&bundle, basePath.c_str(), "Windows-1252", mapFiles), test, "opening the bundle"))
+            return;
+        st_strings_handle handles[3] = { NULL, NULL, NULL };
+        for (size_t i=0; i < 3; i++) {
+            if (check_code(state, st_bundle_get_handle(bundle, bundleTypes[i], &handles[i]), test, "getting a file's handle"))
+                check_string(state, handles[i], 1, bundleStrings[i], test, "a string read differs from that in its file");
+        }
+
+        //Saving writes each file's changes to the file of its type.
+        if (handles[0] != NULL && handles[1] != NULL) {
+            check_code(state, st_replace_string(handles[0], 1, "Renamed"), test, "replacing a string");
+            check_code(state, st_add_string(handles[1], 2, "Added"), test, "adding a string");
+        }
+        check_code(state, st_bundle_save(bundle, savedPath.c_str(), "Windows-1252"), test, "saving the bundle");
+        st_bundle_close(bundle);
+
+        bundle = NULL;
+        if (!check_code(state, st_bundle_open(&bundle, savedPath.c_str(), "Windows-1252", mapFiles), test, "reopening the saved bundle"))
+            return;
+        const char * const saved[] = { "Renamed", "Description", "Line" };
+        for (size_t i=0; i < 3; i++) {
+            st_strings_handle sh = NULL;
+            if (check_code(state, st_bundle_get_handle(bundle, bundleTypes[i], &sh), test, "getting a saved file's handle")) {
+                check_string(state, sh, 1, saved[i], test, "a string read back differs from that saved");
+                check(state, count_strings(state, sh, test) == (i == 1 ? 2U : 1U), test, "a saved file holds the wrong number of strings");
+            }
+        }
+        st_bundle_close(bundle);
+    }
+
+    void test_bundle_missing_file(test_state& state) {
+        const char * test = "bundle with a missing file";
+        const string basePath = file_path(state, "open-test-bundle-missing");
+        write_bundle(basePath);
+        remove((basePath + ".ILSTRINGS").c_str());
+
+        //As with st_open(), a missing file is given a handle for a new, empty file.
+        st_strings_bundle bundle = NULL;
+        if (!check_code(state, st_bundle_open(&bundle, basePath.c_str(), "Windows-1252", false), test, "opening the bundle"))
+            return;
+        for (size_t i=0; i < 3; i++) {
+            st_strings_handle sh = NULL;
+            if (!check_code(state, st_bundle_get_handle(bundle, bundleTypes[i], &sh), test, "getting a file's handle"))
+                continue;
+            if (i == 2)
+                check(state, count_strings(state, sh, test) == 0, test, "the missing file's handle has strings");
+            else
+                check_string(state, sh, 1, bundleStrings[i], test, "a string read differs from that in its file");
+        }
+        st_bundle_close(bundle);
+    }
+
+    void test_bundle_corrupt_file(test_state& state) {
+        const char * test = "bundle with a corrupt file";
+        const string basePath = file_path(state, "open-test-bundle-corrupt");
+        write_bundle(basePath);
+        write_corrupt_file(basePath + ".DLSTRINGS");
+
+        st_strings_bundle bundle = NULL;
+        check(state, st_bundle_open(&bundle, basePath.c_str(), "Windows-1252", false) == LIBSTRINGS_ERROR_FILE_READ_FAIL, test, "a bundle with a corrupt file was opened");
+        check(state, bundle == NULL, test, "a bundle was output for a corrupt file");
+
+        const char * message = NULL;
+        st_get_error_message(&message);
+        check(state, message != NULL && contains(message, "open-test-bundle-corrupt.DLSTRINGS"), test, "the error doesn't name the corrupt file");
+        st_bundle_close(bundle);
+    }
+
+    //Checks that a collection entry failed to load, and that its message names its file.
+    void check_failed_entry(test_state& state, st_strings_collection collection, const size_t index, const string& path, const char * test, const char * what) {
+        const char * entryPath = NULL;
+        st_strings_handle sh = NULL;
+        unsigned int code = LIBSTRINGS_OK;
+        const char * message = NULL;
+        if (!check_code(state, st_collection_get_entry(collection, index, &entryPath, &sh, &code, &message), test, "getting an entry"))
+            return;
+        check(state, entryPath != NULL && string(entryPath) == path, test, "an entry's path differs from that given");
+        check(state, code == LIBSTRINGS_ERROR_FILE_READ_FAIL && sh == NULL, test, what);
+        check(state, message != NULL && contains(message, path), test, "a failed entry's message doesn't name its file");
+    }
+
+    void test_collection(test_state& state) {
+        const char * test = "collection";
+        const string goodPath = file_path(state, "open-test-collection.STRINGS");
+        const string missingPath = file_path(state, "open-test-collection-missing.STRINGS");
+        const string corruptPath = file_path(state, "open-test-collection-corrupt.DLSTRINGS");
+        write_string_file(goodPath, 1, "Loaded");
+        remove(missingPath.c_str());
+        write_corrupt_file(corruptPath);
+
+        //Files that can't be loaded are reported in their entries, and don't stop the others loading.
+        const char * paths[] = { goodPath.c_str(), missingPath.c_str(), corruptPath.c_str() };
+        st_strings_collection collection = NULL;
+        if (!check_code(state, st_collection_open_paths(&collection, paths, 3, "Windows-1252", false, 2), test, "opening the collection"))
+            return;
+
+        size_t size = 0;
+        if (check_code(state, st_collection_get_size(collection, &size), test, "getting the collection's size"))
+            check(state, size == 3, test, "the collection doesn't have an entry for each path");
+
+        const char * path = NULL;
+        st_strings_handle sh = NULL;
+        unsigned int code = LIBSTRINGS_ERROR_FILE_READ_FAIL;
+        const char * message = "";
+        if (check_code(state, st_collection_get_entry(collection, 0, &path, &sh, &code, &message), test, "getting an entry")) {
+            check(state, code == LIBSTRINGS_OK && message == NULL && sh != NULL, test, "a file that exists wasn't loaded");
+            if (sh != NULL)
+                check_string(state, sh, 1, "Loaded", test, "a string read differs from that in its file");
+        }
+
+        //Unlike st_open(), a collection doesn't make a handle for a file that doesn't exist.
+        check_failed_entry(state, collection, 1, missingPath, test, "a file that doesn't exist was loaded");
+        check_failed_entry(state, collection, 2, corruptPath, test, "a corrupt file was loaded");
+        st_collection_close(collection);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    test_state state;
+    state.dir = argc > 1 ? argv[1] : ".";
+
+    test_open_ex(state);
+    test_bad_prefixes(state, false);
+    test_bad_prefixes(state, true);
+    test_bundle(state, false);
+    test_bundle(state, true);
+    test_bundle_missing_file(state);
+    test_bundle_corrupt_file(state);
+    test_collection(state);
+
+    st_cleanup();
+
+    if (state.failures > 0) {
+        printf("FAILED: %u of %u checks\n", (unsigned int)state.failures, (unsigned int)state.checks);
+        return 1;
+    }
+
+    printf("All %u checks passed.\n", (unsigned int)state.checks);
+    return 0;
+}
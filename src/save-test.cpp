@@ -0,0 +1,525 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/* Saves files through the library's API and reopens them to check that
+   the strings read back are the ones saved, for the ways of saving that
+   lay files out differently to a plain st_save().
+   Usage: libstrings-save-test [directory]
+   The files are written to the given directory, or the working directory
+   if none is given. Exits with a non-zero status if any check fails. */
+
+#include "libstrings.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+namespace {
+    typedef map<uint32_t, string> string_map;
+
+    struct test_state {
+        test_state() : checks(0), failures(0) {}
+
+        size_t checks;
+        size_t failures;
+        string dir;
+    };
+
+    void check(test_state& state, const bool passed, const char * test, const char * what) {
+        state.checks++;
+        if (!passed) {
+            state.failures++;
+            printf("FAILED: %s: %s\n", test, what);
+        }
+    }
+
+    bool check_code(test_state& state, const unsigned int code, const char * test, const char * what) {
+        check(state, code == LIBSTRINGS_OK, test, what);
+        if (code != LIBSTRINGS_OK) {
+            const char * details = NULL;
+            st_get_error_message(&details);
+            printf("    error %u: %s\n", code, details == NULL ? "" : details);
+        }
+        return code == LIBSTRINGS_OK;
+    }
+
+    string file_path(const test_state& state, const char * name) {
+        return state.dir + "/" + name;
+    }
+
+    string read_file(const string& path) {
+        ifstream in(path.c_str(), ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    void write_file(const string& path, const string& contents) {
+        ofstream out(path.c_str(), ios::binary | ios::trunc);
+        out.write(contents.data(), contents.size());
+    }
+
+    void put_uint32(string& out, const uint32_t value) {
+        for (size_t i=0; i < 4; i++)
+            out += (char)((value >> (8 * i)) & 0xFF);
+    }
+
+    //Builds a STRINGS file holding the given raw strings in ID order, followed by strings that no ID refers to.
+    string build_file(const string_map& strings, const vector<string>& unreferenced) {
+        string directory, data;
+        for (string_map::const_iterator it=strings.begin(), endIt=strings.end(); it != endIt; ++it) {
+            put_uint32(directory, it->first);
+            put_uint32(directory, (uint32_t)data.size());
+            data += it->second;
+            data += '\0';
+        }
+        for (size_t i=0; i < unreferenced.size(); i++) {
+            data += unreferenced[i];
+            data += '\0';
+        }
+
+        string file;
+        put_uint32(file, (uint32_t)strings.size());
+        put_uint32(file, (uint32_t)data.size());
+        return file + directory + data;
+    }
+
+    bool contains(const string& haystack, const string& needle) {
+        return haystack.find(needle) != string::npos;
+    }
+
+    //Creates a handle for a new file holding the given strings.
+    st_strings_handle new_handle(test_state& state, const string& path, const string_map& strings, const char * test) {
+        remove(path.c_str());
+        st_strings_handle sh = NULL;
+        if (!check_code(state, st_open(&sh, path.c_str(), "Windows-1252"), test, "creating a handle"))
+            return NULL;
+
+        for (string_map::const_iterator it=strings.begin(), endIt=strings.end(); it != endIt; ++it) {
+            if (!check_code(state, st_add_string(sh, it->first, it->second.c_str()), test, "adding a string")) {
+                st_close(sh);
+                return NULL;
+            }
+        }
+        return sh;
+    }
+
+    string_map get_strings(test_state& state, st_strings_handle sh, const char * test) {
+        string_map strings;
+        st_string_data * data = NULL;
+        size_t count = 0;
+        if (check_code(state, st_get_strings(sh, &data, &count), test, "getting strings")) {
+            for (size_t i=0; i < count; i++)
+                strings[data[i].id] = data[i].data;
+        }
+        return strings;
+    }
+
+    //Reopens the given file and checks that it holds the given strings.
+    void check_file(test_state& state, const string& path, const char * fallbackEncoding, const string_map& expected, const char * test, const char * what) {
+        st_strings_handle sh = NULL;
+        if (!check_code(state, st_open(&sh, path.c_str(), fallbackEncoding), test, "reopening the file"))
+            return;
+        check(state, get_strings(state, sh, test) == expected, test, what);
+        st_close(sh);
+    }
+
+    //Strings that end other strings, so that merging tails has something to do.
+    string_map tail_strings() {
+        string_map strings;
+        strings[1] = "Iron Sword";
+        strings[2] = "Sword";
+        strings[3] = "word";
+        strings[4] = "Iron Sword";
+        strings[5] = "";
+        strings[6] = "Steel Sword";
+        strings[7] = "d";
+        strings[8] = "Dagger";
+        strings[9] = "Caf\xC3\xA9";
+        strings[10] = "\xC3\xA9";
+        return strings;
+    }
+
+    void test_verbatim_save(test_state& state) {
+        const char * test = "verbatim save";
+        const string path = file_path(state, "save-test-raw.STRINGS");
+        const string savedPath = file_path(state, "save-test-raw-saved.STRINGS");
+
+        //0x81 isn't a Windows-1252 character, so the string can only be saved as it is.
+        string_map raw;
+        raw[1] = "Caf\xE9";
+        raw[2] = "\x81undecodable";
+        raw[3] = "Plain";
+        raw[4] = "Caf\xE9";
+        raw[5] = "Old";
+        write_file(path, build_file(raw, vector<string>()));
+
+        st_set_stats_enabled(true);
+        st_strings_handle sh = NULL;
+        if (!check_code(state, st_open(&sh, path.c_str(), "Windows-1252"), test, "opening the file")) {
+            st_set_stats_enabled(false);
+            return;
+        }
+        check_code(state, st_replace_string(sh, 5, "New \xC3\xA9"), test, "replacing a string");
+        check_code(state, st_save(sh, savedPath.c_str(), "Windows-1252"), test, "saving in the fallback encoding");
+
+        st_stats stats;
+        if (check_code(state, st_get_stats(sh, &stats), test, "getting statistics"))
+            check(state, stats.stringsTranscoded == 0, test, "untouched strings were transcoded");
+        st_close(sh);
+        st_set_stats_enabled(false);
+
+        const string saved = read_file(savedPath);
+        check(state, contains(saved, string("Caf\xE9\0", 5)), test, "a transcoded string wasn't saved as it was read");
+        check(state, contains(saved, string("\x81undecodable\0", 13)), test, "an undecodable string wasn't saved as it was read");
+        check(state, contains(saved, string("New \xE9\0", 6)), test, "the replaced string wasn't encoded");
+        check(state, saved.find("Caf\xE9") == saved.rfind("Caf\xE9"), test, "the raw strings weren't deduplicated");
+
+        if (!check_code(state, st_open(&sh, savedPath.c_str(), "Windows-1252"), test, "reopening the file"))
+            return;
+        const char * expected[] = { "Caf\xC3\xA9", NULL, "Plain", "Caf\xC3\xA9", "New \xC3\xA9" };
+        for (uint32_t id=1; id <= 5; id++) {
+            char * str = NULL;
+            const unsigned int code = st_get_string(sh, id, &str);
+            if (expected[id - 1] == NULL)
+                check(state, code == LIBSTRINGS_ERROR_BAD_STRING, test, "the undecodable string was changed");
+            else
+                check(state, code == LIBSTRINGS_OK && string(str) == expected[id - 1], test, "a string read back differs from that saved");
+        }
+        st_close(sh);
+    }
+
+    void test_merge_tails(test_state& state) {
+        const char * test = "merge tails";
+        const string_map strings = tail_strings();
+        const string plainPath = file_path(state, "save-test-plain.STRINGS");
+        const string mergedPath = file_path(state, "save-test-merged.STRINGS");
+        const string threadedPath = file_path(state, "save-test-merged-threaded.STRINGS");
+
+        st_strings_handle sh = new_handle(state, plainPath, strings, test);
+        if (sh == NULL)
+            return;
+        check_code(state, st_save(sh, plainPath.c_str(), "Windows-1252"), test, "saving without options");
+        check_code(state, st_save_ex(sh, mergedPath.c_str(), "Windows-1252", 1, LIBSTRINGS_SAVE_MERGE_TAILS), test, "saving with merged tails");
+        check_code(state, st_save_ex(sh, threadedPath.c_str(), "Windows-1252", 4, LIBSTRINGS_SAVE_MERGE_TAILS), test, "saving with merged tails using several threads");
+        st_close(sh);
+
+        const string merged = read_file(mergedPath);
+        check(state, merged.size() < read_file(plainPath).size(), test, "merging tails didn't make the file smaller");
+        check(state, read_file(threadedPath) == merged, test, "saving using several threads changed the file");
+        check_file(state, mergedPath, "Windows-1252", strings, test, "the strings read back differ from those saved");
+
+        //DLSTRINGS strings can't share their bytes, so the option is ignored.
+        const string dlPlainPath = file_path(state, "save-test-plain.DLSTRINGS");
+        const string dlMergedPath = file_path(state, "save-test-merged.DLSTRINGS");
+        sh = new_handle(state, dlPlainPath, strings, test);
+        if (sh == NULL)
+            return;
+        check_code(state, st_save(sh, dlPlainPath.c_str(), "Windows-1252"), test, "saving a DLSTRINGS file");
+        check_code(state, st_save_ex(sh, dlMergedPath.c_str(), "Windows-1252", 1, LIBSTRINGS_SAVE_MERGE_TAILS), test, "saving a DLSTRINGS file with merged tails");
+        st_close(sh);
+
+        check(state, read_file(dlMergedPath) == read_file(dlPlainPath), test, "merging tails changed a DLSTRINGS file");
+        check_file(state, dlMergedPath, "Windows-1252", strings, test, "the DLSTRINGS strings read back differ from those saved");
+    }
+
+    void test_patch(test_state& state) {
+        const char * test = "patch";
+        const string path = file_path(state, "save-test-patch.STRINGS");
+
+        //Each string and its terminator is as long as a directory entry, so that the grown directory covers whole strings.
+        string_map strings;
+        for (uint32_t id=1; id <= 10; id++) {
+            char str[8];
+            sprintf(str, "Item %02u", (unsigned int)id);
+            strings[id] = str;
+        }
+        st_strings_handle sh = new_handle(state, path, strings, test);
+        if (sh == NULL)
+            return;
+        check_code(state, st_save(sh, path.c_str(), "Windows-1252"), test, "saving the original file");
+        st_close(sh);
+        const string original = read_file(path);
+
+        if (!check_code(state, st_open(&sh, path.c_str(), "Windows-1252"), test, "opening the file"))
+            return;
+        strings[2] = "Longsword";
+        strings[20] = "Warhammer";
+        check_code(state, st_replace_string(sh, 2, strings[2].c_str()), test, "replacing a string");
+        check_code(state, st_add_string(sh, 20, strings[20].c_str()), test, "adding a string");
+        check_code(state, st_save_patch(sh, "Windows-1252"), test, "patching the file");
+
+        //Past the grown directory, the original strings are left where they were.
+        const size_t directoryEnd = 8 + 8 * strings.size();
+        const string patched = read_file(path);
+        check(state, patched.size() > original.size() && patched.compare(directoryEnd, original.size() - directoryEnd, original, directoryEnd, string::npos) == 0, test, "the file was rewritten rather than patched");
+        check_file(state, path, "Windows-1252", strings, test, "the strings read back after a patch differ from those saved");
+
+        //The handle must know where its strings now are to patch the file again.
+        strings[20] = "War Axe";
+        strings.erase(7);
+        check_code(state, st_replace_string(sh, 20, strings[20].c_str()), test, "replacing a string again");
+        check_code(state, st_remove_string(sh, 7), test, "removing a string");
+        check_code(state, st_save_patch(sh, "Windows-1252"), test, "patching the file again");
+        st_close(sh);
+        check_file(state, path, "Windows-1252", strings, test, "the strings read back after a second patch differ from those saved");
+    }
+
+    //Growing the directory over part of a string mustn't leave the rest of it behind as another string.
+    void test_patch_split_string(test_state& state, const char * name) {
+        const char * test = "patch over part of a string";
+        const string path = file_path(state, name);
+
+        string_map strings;
+        strings[1] = "HelloWorldLong";
+        st_strings_handle sh = new_handle(state, path, strings, test);
+        if (sh == NULL)
+            return;
+        check_code(state, st_save(sh, path.c_str(), "Windows-1252"), test, "saving the original file");
+        st_close(sh);
+
+        if (!check_code(state, st_open(&sh, path.c_str(), "Windows-1252"), test, "opening the file"))
+            return;
+        strings[2] = "x";
+        check_code(state, st_add_string(sh, 2, strings[2].c_str()), test, "adding a string");
+        check_code(state, st_save_patch(sh, "Windows-1252"), test, "patching the file");
+        st_close(sh);
+        check_file(state, path, "Windows-1252", strings, test, "the strings read back after a patch differ from those saved");
+
+        if (!check_code(state, st_open(&sh, path.c_str(), "Windows-1252"), test, "reopening the file"))
+            return;
+        char ** unref = NULL;
+        size_t count = 0;
+        if (check_code(state, st_get_unref_strings(sh, &unref, &count), test, "getting unreferenced strings"))
+            check(state, count == 0, test, "part of an overwritten string was left in the file");
+        st_close(sh);
+    }
+
+    void test_patch_after_rewrite(test_state& state) {
+        const char * test = "patch after rewrite";
+        const string path = file_path(state, "save-test-rewritten.STRINGS");
+
+        string_map strings = tail_strings();
+        st_strings_handle sh = new_handle(state, path, strings, test);
+        if (sh == NULL)
+            return;
+        check_code(state, st_save(sh, path.c_str(), "Windows-1252"), test, "saving the original file");
+        st_close(sh);
+        const size_t originalSize = read_file(path).size();
+        const time_t originalTime = boost::filesystem::last_write_time(path);
+
+        if (!check_code(state, st_open(&sh, path.c_str(), "Windows-1252"), test, "opening the file"))
+            return;
+
+        //Swapping two strings' IDs moves their offsets without changing the file's size.
+        string_map swapped = strings;
+        swapped[1] = strings[8];
+        swapped[8] = strings[1];
+        st_strings_handle other = new_handle(state, file_path(state, "save-test-other.STRINGS"), swapped, test);
+        if (other != NULL) {
+            check_code(state, st_save(other, path.c_str(), "Windows-1252"), test, "rewriting the file");
+            st_close(other);
+        }
+        boost::filesystem::last_write_time(path, originalTime);
+        check(state, read_file(path).size() == originalSize, test, "the rewritten file's size changed");
+
+        strings[3] = "Word";
+        check_code(state, st_replace_string(sh, 3, strings[3].c_str()), test, "replacing a string");
+        check_code(state, st_save_patch(sh, "Windows-1252"), test, "patching the file");
+        st_close(sh);
+        check_file(state, path, "Windows-1252", strings, test, "the file was patched using offsets from before it was rewritten");
+    }
+
+    void test_async_save_over_source(test_state& state, const bool mapFile) {
+        const char * test = mapFile ? "async save over a mapped source" : "async save over the source";
+        const string path = file_path(state, "save-test-async.STRINGS");
+
+        string_map strings;
+        strings[1] = "Referenced";
+        strings[2] = "Also referenced";
+        vector<string> unreferenced(1, "Orphan");
+        write_file(path, build_file(strings, unreferenced));
+
+        st_strings_handle sh = NULL;
+        const unsigned int code = mapFile ? st_open_mapped(&sh, path.c_str(), "Windows-1252") : st_open(&sh, path.c_str(), "Windows-1252");
+        if (!check_code(state, code, test, "opening the file"))
+            return;
+
+        st_async_op op = NULL;
+        if (check_code(state, st_save_async(&op, sh, path.c_str(), "UTF-8", NULL, NULL), test, "starting the save")) {
+            check_code(state, st_async_wait(op), test, "waiting for the save");
+            unsigned int saveCode = LIBSTRINGS_OK;
+            const char * message = NULL;
+            if (check_code(state, st_async_get_result(op, &saveCode, &message, NULL), test, "getting the save's result"))
+                check(state, saveCode == LIBSTRINGS_OK, test, message == NULL ? "saving the file" : message);
+            st_async_free(op);
+        }
+
+        //The unreferenced strings are those of the file the handle was opened from, not of the one saved over it.
+        char ** unref = NULL;
+        size_t count = 0;
+        if (check_code(state, st_get_unref_strings(sh, &unref, &count), test, "getting unreferenced strings"))
+            check(state, count == 1 && string(unref[0]) == "Orphan", test, "the unreferenced strings differ from those in the file opened");
+        check(state, get_strings(state, sh, test) == strings, test, "the handle's strings changed");
+        st_close(sh);
+
+        check_file(state, path, "Windows-1252", strings, test, "the strings read back differ from those saved");
+    }
+
+    //Getting an open's result without its handle must leave the handle to be got later.
+    void test_async_open_result(test_state& state) {
+        const char * test = "async open result";
+        const string path = file_path(state, "save-test-async-open.STRINGS");
+
+        string_map strings;
+        strings[1] = "Opened";
+        write_file(path, build_file(strings, vector<string>()));
+
+        st_async_op op = NULL;
+        if (!check_code(state, st_open_async(&op, path.c_str(), "Windows-1252", false, NULL, NULL), test, "starting the open"))
+            return;
+        check_code(state, st_async_wait(op), test, "waiting for the open");
+
+        unsigned int code = LIBSTRINGS_OK;
+        const char * message = NULL;
+        if (check_code(state, st_async_get_result(op, &code, &message, NULL), test, "getting the open's result without its handle"))
+            check(state, code == LIBSTRINGS_OK, test, message == NULL ? "opening the file" : message);
+
+        st_strings_handle sh = NULL;
+        if (check_code(state, st_async_get_result(op, &code, &message, &sh), test, "getting the opened handle")) {
+            check(state, sh != NULL, test, "the handle was closed before it was got");
+            if (sh != NULL)
+                check(state, get_strings(state, sh, test) == strings, test, "the opened handle's strings differ from those in the file");
+        }
+        st_async_free(op);
+        st_close(sh);
+    }
+
+    void check_memory_handle(test_state& state, st_strings_handle sh, const string_map& expected, const char * test, const char * what) {
+        check(state, get_strings(state, sh, test) == expected, test, what);
+
+        char ** unref = NULL;
+        size_t count = 0;
+        if (check_code(state, st_get_unref_strings(sh, &unref, &count), test, "getting unreferenced strings"))
+            check(state, count == 1 && string(unref[0]) == "Orphan", test, "the unreferenced strings differ from those in the buffer");
+    }
+
+    void test_memory(test_state& state) {
+        const char * test = "memory";
+
+        string_map raw;
+        raw[1] = "Caf\xE9";
+        raw[2] = "Plain";
+        raw[3] = "Caf\xE9";
+        const string file = build_file(raw, vector<string>(1, "Orphan"));
+        string_map strings = raw;
+        strings[1] = strings[3] = "Caf\xC3\xA9";
+
+        //A copied buffer can be changed once the handle is open.
+        vector<uint8_t> buffer(file.begin(), file.end());
+        st_strings_handle sh = NULL;
+        if (check_code(state, st_open_from_memory(&sh, &buffer[0], buffer.size(), LIBSTRINGS_FILE_STRINGS, "Windows-1252", false), test, "opening a copied buffer")) {
+            fill(buffer.begin(), buffer.end(), 'x');
+            check_memory_handle(state, sh, strings, test, "the strings read from a copied buffer differ from those in it");
+            check(state, st_save_patch(sh, "Windows-1252") == LIBSTRINGS_ERROR_INVALID_ARGS, test, "a handle opened from memory was patched");
+            check(state, st_compact(sh, "Windows-1252") == LIBSTRINGS_ERROR_INVALID_ARGS, test, "a handle opened from memory was compacted");
+            st_close(sh);
+        }
+
+        //A borrowed buffer is used in place, and must still allow strings to be changed.
+        buffer.assign(file.begin(), file.end());
+        if (check_code(state, st_open_from_memory(&sh, &buffer[0], buffer.size(), LIBSTRINGS_FILE_STRINGS, "Windows-1252", true), test, "opening a borrowed buffer")) {
+            check_memory_handle(state, sh, strings, test, "the strings read from a borrowed buffer differ from those in it");
+            strings[2] = "Changed";
+            check_code(state, st_replace_string(sh, 2, strings[2].c_str()), test, "replacing a string");
+            check_memory_handle(state, sh, strings, test, "the strings read from a borrowed buffer differ from those set");
+            check(state, buffer == vector<uint8_t>(file.begin(), file.end()), test, "the borrowed buffer was changed");
+            st_close(sh);
+        }
+
+        //Saving to memory gives the same bytes as saving to a file, which read back the same.
+        const struct {
+            unsigned int type;
+            const char * name;
+        } types[] = {
+            { LIBSTRINGS_FILE_STRINGS, "save-test-memory.STRINGS" },
+            { LIBSTRINGS_FILE_DLSTRINGS, "save-test-memory.DLSTRINGS" },
+            { LIBSTRINGS_FILE_ILSTRINGS, "save-test-memory.ILSTRINGS" }
+        };
+        strings = tail_strings();
+        for (size_t i=0; i < sizeof(types) / sizeof(types[0]); i++) {
+            const string path = file_path(state, types[i].name);
+            sh = new_handle(state, path, strings, test);
+            if (sh == NULL)
+                continue;
+
+            const uint8_t * saved = NULL;
+            size_t size = 0;
+            check_code(state, st_save(sh, path.c_str(), "Windows-1252"), test, "saving to a file");
+            if (check_code(state, st_save_to_memory(sh, types[i].type, "Windows-1252", &saved, &size), test, "saving to memory")) {
+                check(state, string((const char*)saved, size) == read_file(path), test, "saving to memory gave a different file to saving to disk");
+
+                st_strings_handle reopened = NULL;
+                if (check_code(state, st_open_from_memory(&reopened, saved, size, types[i].type, "Windows-1252", false), test, "reopening the saved buffer")) {
+                    check(state, get_strings(state, reopened, test) == strings, test, "the strings read back from memory differ from those saved");
+                    st_close(reopened);
+                }
+            }
+            st_close(sh);
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    test_state state;
+    state.dir = argc > 1 ? argv[1] : ".";
+
+    test_merge_tails(state);
+    test_verbatim_save(state);
+    test_patch(state);
+    test_patch_split_string(state, "save-test-split.STRINGS");
+    test_patch_split_string(state, "save-test-split.DLSTRINGS");
+    test_patch_after_rewrite(state);
+    test_async_save_over_source(state, false);
+    test_async_save_over_source(state, true);
+    test_async_open_result(state);
+    test_memory(state);
+
+    st_async_shutdown();
+    st_cleanup();
+
+    if (state.failures > 0) {
+        printf("FAILED: %u of %u checks\n", (unsigned int)state.failures, (unsigned int)state.checks);
+        return 1;
+    }
+
+    printf("All %u checks passed.\n", (unsigned int)state.checks);
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "stats.h"
+
+#if defined(_WIN32)
+#   include <windows.h>
+#else
+#   include <time.h>
+#endif
+
+namespace libstrings {
+    bool statsEnabled = false;
+
+    uint64_t now_ns() {
+#if defined(_WIN32)
+        LARGE_INTEGER frequency, counter;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&counter);
+        return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    }
+
+    void add_stats(st_stats& total, const st_stats& other) {
+        total.bytesRead += other.bytesRead;
+        total.bytesWritten += other.bytesWritten;
+        total.entries += other.entries;
+        total.unreferencedStrings += other.unreferencedStrings;
+        total.stringsTranscoded += other.stringsTranscoded;
+        total.stringsPassedThrough += other.stringsPassedThrough;
+        total.stringsSaved += other.stringsSaved;
+        total.uniqueStringsSaved += other.uniqueStringsSaved;
+        total.readTime += other.readTime;
+        total.parseTime += other.parseTime;
+        total.decodeTime += other.decodeTime;
+        total.scanTime += other.scanTime;
+        total.dedupeTime += other.dedupeTime;
+        total.encodeTime += other.encodeTime;
+        total.layoutTime += other.layoutTime;
+        total.writeTime += other.writeTime;
+    }
+
+    stats_timer::stats_timer(st_stats * stats, uint64_t st_stats::* field) :
+        _stats(stats),
+        _field(field),
+        _start(stats == NULL ? 0 : now_ns()) {}
+
+    stats_timer::~stats_timer() {
+        if (_stats != NULL)
+            _stats->*_field += now_ns() - _start;
+    }
+}
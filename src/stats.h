@@ -0,0 +1,53 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_STATS_H__
+#define __LIBSTRINGS_STATS_H__
+
+#include "libstrings.h"
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+
+namespace libstrings {
+    //Whether handles collect statistics. When false, collecting them costs a check of this for each phase timed and string decoded.
+    extern bool statsEnabled;
+
+    //A monotonic time in nanoseconds.
+    uint64_t now_ns();
+
+    //Adds the counters and times in one set of statistics to another.
+    void add_stats(st_stats& total, const st_stats& other);
+
+    //Adds the time from its creation to its destruction to a field of the given statistics, unless they are NULL.
+    class stats_timer : boost::noncopyable {
+    public:
+        stats_timer(st_stats * stats, uint64_t st_stats::* field);
+        ~stats_timer();
+    private:
+        st_stats * _stats;
+        uint64_t st_stats::* _field;
+        uint64_t _start;
+    };
+}
+
+#endif
@@ -0,0 +1,183 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include "trace.h"
+#include "stats.h"
+#include "error.h"
+#include <cstdio>
+#include <new>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+using namespace std;
+using namespace libstrings;
+
+namespace {
+    struct trace_event {
+        const char * name;  //Names are string literals, so can be kept as pointers.
+        bool begin;
+        uint64_t time;
+        unsigned int thread;
+    };
+
+    /* Records events in memory, and writes them out in Chrome's trace event
+       format when stopped, so that writing doesn't distort the timings. */
+    class trace_file {
+    public:
+        trace_file(const string& path) : _path(path), _start(now_ns()), _dropped(0), _written(false) {}
+
+        //Events are recorded from destructors, so can't throw: any that can't be stored are counted and dropped.
+        void record(const char * name, const bool begin) {
+            const uint64_t time = now_ns();
+            boost::mutex::scoped_lock lock(_mutex);
+
+            //Spans still open on other threads when the file was written end too late to be in it.
+            if (_written)
+                return;
+
+            try {
+                //Give threads small IDs in the order they are first seen.
+                const boost::thread::id threadId = boost::this_thread::get_id();
+                boost::unordered_map<boost::thread::id, unsigned int>::iterator it = _threads.find(threadId);
+                if (it == _threads.end())
+                    it = _threads.insert(pair<boost::thread::id, unsigned int>(threadId, _threads.size() + 1)).first;
+
+                trace_event event;
+                event.name = name;
+                event.begin = begin;
+                event.time = time - _start;
+                event.thread = it->second;
+                _events.push_back(event);
+            } catch (bad_alloc&) {
+                _dropped++;
+            }
+        }
+
+        void write() {
+            boost::mutex::scoped_lock lock(_mutex);
+            _written = true;
+
+            FILE * out = fopen(_path.c_str(), "wb");
+            if (out == NULL)
+                throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + _path + "\".");
+
+            fprintf(out, "{\"traceEvents\":[\n");
+            for (size_t i=0; i < _events.size(); i++) {
+                const trace_event& e = _events[i];
+                fprintf(out, "{\"name\":\"%s\",\"cat\":\"libstrings\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}%s\n",
+                    e.name, e.begin ? "B" : "E", e.time / 1000.0, e.thread, i + 1 < _events.size() ? "," : "");
+            }
+            fprintf(out, "],\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedEvents\":%lu}}\n", (unsigned long)_dropped);
+
+            if (fclose(out) != 0)
+                throw error(LIBSTRINGS_ERROR_FILE_WRITE_FAIL, "Could not write to \"" + _path + "\".");
+        }
+    private:
+        const string _path;
+        const uint64_t _start;
+        boost::mutex _mutex;
+        vector<trace_event> _events;
+        size_t _dropped;
+        bool _written;
+        boost::unordered_map<boost::thread::id, unsigned int> _threads;
+    };
+
+    /* The registered tracer, or NULL if there isn't one, which spans on any
+       thread may be reading. The flag mirrors whether there is one, so that
+       spans can skip locking the mutex when tracing is off. A span that
+       reads it just as a tracer is registered or removed may miss or
+       catch that tracer, as it would if it had started a moment earlier. */
+    boost::mutex tracerMutex;
+    boost::atomic<bool> tracerRegistered(false);
+    st_trace_callback traceCallback = NULL;
+    void * traceContext = NULL;
+    boost::shared_ptr<trace_file> traceFile;
+
+    void record_to_file(const char * name, const bool begin, void * context) {
+        static_cast<trace_file*>(context)->record(name, begin);
+    }
+}
+
+namespace libstrings {
+    trace_scope::trace_scope(const char * name) : _name(name), _callback(NULL), _context(NULL) {
+        if (!tracerRegistered.load(boost::memory_order_acquire))
+            return;
+
+        {
+            boost::mutex::scoped_lock lock(tracerMutex);
+            _callback = traceCallback;
+            _context = traceContext;
+            if (traceFile && _context == traceFile.get())
+                _owner = traceFile;
+        }
+
+        if (_callback != NULL)
+            _callback(_name, true, _context);
+    }
+
+    trace_scope::~trace_scope() {
+        if (_callback != NULL)
+            _callback(_name, false, _context);
+    }
+
+    void SetTracer(st_trace_callback callback, void * context) {
+        boost::mutex::scoped_lock lock(tracerMutex);
+        traceCallback = callback;
+        traceContext = context;
+        tracerRegistered.store(callback != NULL, boost::memory_order_release);
+    }
+
+    void StartTraceFile(const string& path) {
+        StopTraceFile();
+        boost::shared_ptr<trace_file> file(new trace_file(path));
+
+        boost::mutex::scoped_lock lock(tracerMutex);
+        traceFile = file;
+        traceCallback = &record_to_file;
+        traceContext = file.get();
+        tracerRegistered.store(true, boost::memory_order_release);
+    }
+
+    /* The file is unregistered before it is written, even if writing fails.
+       Spans still open on other threads hold their own references to it, so
+       it is only destroyed once the last of them has ended. */
+    void StopTraceFile() {
+        boost::shared_ptr<trace_file> file;
+        {
+            boost::mutex::scoped_lock lock(tracerMutex);
+            file.swap(traceFile);
+            if (!file)
+                return;
+            if (traceContext == file.get()) {
+                traceCallback = NULL;
+                traceContext = NULL;
+                tracerRegistered.store(false, boost::memory_order_release);
+            }
+        }
+
+        file->write();
+    }
+}
@@ -0,0 +1,64 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBSTRINGS_TRACE_H__
+#define __LIBSTRINGS_TRACE_H__
+
+#include "libstrings.h"
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace libstrings {
+    //Traces the span from its creation to its destruction, if a tracer is registered when it is created.
+    class trace_scope : boost::noncopyable {
+    public:
+        trace_scope(const char * name);
+        ~trace_scope();
+    private:
+        const char * _name;
+        st_trace_callback _callback;
+        void * _context;
+        boost::shared_ptr<void> _owner;  //Keeps a context the library owns alive until the span ends, even if its tracer is replaced.
+    };
+
+    //Registers a tracer, replacing any existing one. Spans that have already started are still reported to the tracer they started with.
+    void SetTracer(st_trace_callback callback, void * context);
+
+    //Starts and stops recording trace events to a Chrome trace event JSON file.
+    void StartTraceFile(const std::string& path);
+    void StopTraceFile();
+}
+
+/* Traces the rest of the enclosing scope under the given name. Defining
+   LIBSTRINGS_NO_TRACE compiles tracing out, otherwise it costs a check for
+   a registered tracer. */
+#ifdef LIBSTRINGS_NO_TRACE
+#   define LIBSTRINGS_TRACE(name)
+#else
+#   define LIBSTRINGS_TRACE_JOIN(a, b) a##b
+#   define LIBSTRINGS_TRACE_NAME(line) LIBSTRINGS_TRACE_JOIN(traceScope, line)
+#   define LIBSTRINGS_TRACE(name) libstrings::trace_scope LIBSTRINGS_TRACE_NAME(__LINE__)(name)
+#endif
+
+#endif
@@ -0,0 +1,245 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/* Checks each of the UTF-8 validators that the CPU supports against
+   UTF8-CPP, using every short sequence of interesting bytes at every
+   position in a block, and randomly generated and corrupted strings.
+   Usage: libstrings-utf8-test [random cases] [seed]
+   Exits with a non-zero status if any validator disagrees with UTF8-CPP. */
+
+#include "helpers.h"
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <source/utf8.h>
+
+using namespace std;
+using namespace libstrings;
+
+namespace {
+    struct validator_info {
+        utf8_validator validator;
+        const char * name;
+    };
+
+    const validator_info validators[] = {
+        { UTF8_VALIDATOR_SCALAR, "scalar" },
+        { UTF8_VALIDATOR_SSE42, "SSE4.2" },
+        { UTF8_VALIDATOR_AVX2, "AVX2" }
+    };
+    const size_t validatorCount = sizeof(validators) / sizeof(validators[0]);
+
+    //The bytes either side of each boundary between byte classes and the ranges lead bytes allow.
+    const uint8_t interestingBytes[] = {
+        0x00, 0x41, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC1, 0xC2,
+        0xDF, 0xE0, 0xE1, 0xEC, 0xED, 0xEE, 0xEF, 0xF0, 0xF1, 0xF3, 0xF4, 0xF5, 0xFF
+    };
+    const size_t interestingCount = sizeof(interestingBytes) / sizeof(interestingBytes[0]);
+
+    //xorshift64*, so that runs are repeatable across platforms.
+    class random_source {
+    public:
+        random_source(const uint64_t seed) : _state(seed == 0 ? 1 : seed) {}
+
+        uint32_t next() {
+            _state ^= _state >> 12;
+            _state ^= _state << 25;
+            _state ^= _state >> 27;
+            return (uint32_t)((_state * 2685821657736338717ULL) >> 32);
+        }
+
+        uint32_t below(const uint32_t n) { return next() % n; }
+    private:
+        uint64_t _state;
+    };
+
+    struct test_state {
+        test_state() : cases(0), failures(0) {
+            for (size_t i=0; i < validatorCount; i++)
+                enabled[i] = HasUTF8Validator(validators[i].validator);
+        }
+
+        bool enabled[validatorCount];
+        uint64_t cases;
+        uint64_t failures;
+    };
+
+    void print_hex(const string& str) {
+        for (size_t i=0; i < str.length() && i < 80; i++)
+            printf("%02X", (unsigned int)(uint8_t)str[i]);
+        if (str.length() > 80)
+            printf("...");
+        printf(" (%lu bytes)\n", (unsigned long)str.length());
+    }
+
+    void check(test_state& state, const string& str) {
+        const bool expected = utf8::is_valid(str.begin(), str.end());
+        state.cases++;
+        for (size_t i=0; i < validatorCount; i++) {
+            if (!state.enabled[i] || IsValidUTF8With(validators[i].validator, str.data(), str.length()) == expected)
+                continue;
+
+            state.failures++;
+            if (state.failures <= 20) {
+                printf("%s validator says %s, UTF8-CPP says %s: ", validators[i].name, expected ? "invalid" : "valid", expected ? "valid" : "invalid");
+                print_hex(str);
+            }
+        }
+    }
+
+    //Encode a code point, without checking that it is a valid one.
+    void append_code_point(string& str, const uint32_t cp) {
+        if (cp < 0x80) {
+            str += (char)cp;
+        } else if (cp < 0x800) {
+            str += (char)(0xC0 | (cp >> 6));
+            str += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            str += (char)(0xE0 | (cp >> 12));
+            str += (char)(0x80 | ((cp >> 6) & 0x3F));
+            str += (char)(0x80 | (cp & 0x3F));
+        } else {
+            str += (char)(0xF0 | (cp >> 18));
+            str += (char)(0x80 | ((cp >> 12) & 0x3F));
+            str += (char)(0x80 | ((cp >> 6) & 0x3F));
+            str += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    //Pick a valid code point, favouring those near the edges of each encoded length and of the surrogates.
+    uint32_t random_code_point(random_source& random) {
+        static const uint32_t edges[] = { 0x0, 0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFFFF, 0x10000, 0x10FFFF };
+        uint32_t cp;
+        switch (random.below(4)) {
+        case 0:
+            cp = random.below(0x80);
+            break;
+        case 1:
+            cp = edges[random.below(sizeof(edges) / sizeof(edges[0]))];
+            break;
+        default:
+            cp = random.below(0x110000);
+            break;
+        }
+        if (cp >= 0xD800 && cp <= 0xDFFF)
+            cp -= 0x800;
+        return cp;
+    }
+
+    //Every sequence of up to four interesting bytes, at the start of the input and either side of each 16 and 32-byte block boundary, after ASCII or valid multi-byte text.
+    void check_sequences(test_state& state) {
+        static const char * const fillers[] = { "a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80" };
+        static const size_t offsets[] = { 0, 1, 2, 3, 13, 14, 15, 16, 17, 29, 30, 31, 32, 33, 45, 46, 47, 48, 49, 61, 62, 63, 64 };
+        const size_t bufferLength = 64;
+
+        for (size_t f=0; f < sizeof(fillers) / sizeof(fillers[0]); f++) {
+            string filler;
+            while (filler.length() < bufferLength)
+                filler += fillers[f];
+
+            for (size_t length=1; length <= 4; length++) {
+                size_t combinations = 1;
+                for (size_t i=0; i < length; i++)
+                    combinations *= interestingCount;
+
+                for (size_t c=0; c < combinations; c++) {
+                    string sequence;
+                    for (size_t i=0, rest=c; i < length; i++, rest /= interestingCount)
+                        sequence += (char)interestingBytes[rest % interestingCount];
+
+                    //Multi-byte fillers are only kept whole before the sequence, so that the sequence is the only thing that can be invalid.
+                    for (size_t o=0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+                        const size_t offset = offsets[o];
+                        const size_t prefix = offset - offset % strlen(fillers[f]);
+                        string str = filler.substr(0, prefix) + string(offset - prefix, 'a') + sequence;
+                        check(state, str);
+                        check(state, str + "abc");
+                    }
+                }
+            }
+        }
+    }
+
+    //Random valid strings, some of which are then corrupted.
+    void check_random(test_state& state, random_source& random, const size_t count) {
+        for (size_t n=0; n < count; n++) {
+            string str;
+            const size_t codePoints = random.below(8) == 0 ? random.below(400) : random.below(40);
+            for (size_t i=0; i < codePoints; i++)
+                append_code_point(str, random_code_point(random));
+
+            if (!str.empty()) {
+                switch (random.below(6)) {
+                case 0:
+                    str[random.below(str.length())] = (char)random.next();
+                    break;
+                case 1:
+                    str[random.below(str.length())] ^= (char)(1 << random.below(8));
+                    break;
+                case 2:
+                    str.erase(str.length() - 1 - random.below(min((uint32_t)str.length(), 3U)));
+                    break;
+                case 3:
+                    str.insert(random.below(str.length() + 1), 1, (char)interestingBytes[random.below(interestingCount)]);
+                    break;
+                default:
+                    break;
+                }
+            }
+            check(state, str);
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    const size_t randomCases = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    const uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+
+    test_state state;
+    printf("Validators:");
+    for (size_t i=0; i < validatorCount; i++)
+        printf(" %s%s", validators[i].name, state.enabled[i] ? "" : " (unsupported)");
+    printf("\n");
+
+    check_sequences(state);
+    printf("Byte sequences: %llu cases\n", (unsigned long long)state.cases);
+
+    const uint64_t sequenceCases = state.cases;
+    random_source random(seed);
+    check_random(state, random, randomCases);
+    printf("Random strings: %llu cases, seed %llu\n", (unsigned long long)(state.cases - sequenceCases), (unsigned long long)seed);
+
+    if (state.failures > 0) {
+        printf("FAILED: %llu mismatches\n", (unsigned long long)state.failures);
+        return 1;
+    }
+
+    printf("All validators agree with UTF8-CPP.\n");
+    return 0;
+}
@@ -0,0 +1,319 @@
+/*  libstrings
+
+    A library for reading and writing STRINGS, ILSTRINGS and DLSTRINGS files.
+
+    Copyright (C) 2012    WrinklyNinja
+
+    This file is part of libstrings.
+
+    libstrings is free software: you can redistribute
+    it and/or modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    libstrings is distributed in the hope that it will
+    be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libstrings.  If not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/* UTF-8 validation. The vector implementations use the lookup algorithm
+   described in "Validating UTF-8 In Less Than One Instruction Per Byte"
+   (Keiser & Lemire, 2021): each byte's error flags are looked up from the
+   high nibble of the previous byte, the low nibble of the previous byte and
+   the high nibble of the current byte, and ANDed together, so that any
+   non-zero result is an error. Runs of ASCII are skipped a block at a time.
+   The implementation is chosen at startup based on what the CPU supports,
+   falling back to UTF8-CPP. */
+
+#include "helpers.h"
+
+#include <cstring>
+
+#include <source/utf8.h>
+
+#if (defined(__GNUC__) && __GNUC__ >= 5 && (defined(__i386__) || defined(__x86_64__))) || (defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64)))
+#   define LIBSTRINGS_SIMD_UTF8
+#   include <immintrin.h>
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#       define LIBSTRINGS_TARGET(x)
+#   else
+#       define LIBSTRINGS_TARGET(x) __attribute__((target(x)))
+#   endif
+#endif
+
+namespace libstrings {
+
+    namespace {
+        // Skips ASCII eight bytes at a time, then validates the rest with UTF8-CPP.
+        bool IsValidUTF8Scalar(const char * str, const size_t length) {
+            size_t pos = 0;
+            for (; pos + sizeof(uint64_t) <= length; pos += sizeof(uint64_t)) {
+                uint64_t word;
+                memcpy(&word, str + pos, sizeof(uint64_t));
+                if ((word & 0x8080808080808080ULL) != 0)
+                    break;
+            }
+            return utf8::is_valid(str + pos, str + length);
+        }
+
+#ifdef LIBSTRINGS_SIMD_UTF8
+        // Error flags. Each describes a pair of bytes (or more, for the length checks).
+        const uint8_t TOO_SHORT      = 1 << 0;  // 11______ 0_______ or 11______ 11______
+        const uint8_t TOO_LONG       = 1 << 1;  // 0_______ 10______
+        const uint8_t OVERLONG_3     = 1 << 2;  // 11100000 100_____
+        const uint8_t TOO_LARGE      = 1 << 3;  // 11110100 1001____ and above
+        const uint8_t SURROGATE      = 1 << 4;  // 11101101 101_____
+        const uint8_t OVERLONG_2     = 1 << 5;  // 1100000_ 10______
+        const uint8_t TOO_LARGE_1000 = 1 << 6;  // 11110101 1000____ and above
+        const uint8_t OVERLONG_4     = 1 << 6;  // 11110000 1000____
+        const uint8_t TWO_CONTS      = 1 << 7;  // 10______ 10______
+        const uint8_t CARRY          = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+        // Indexed by the high nibble of the first byte.
+        const uint8_t byte1HighTable[16] = {
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            TOO_SHORT | OVERLONG_2,
+            TOO_SHORT,
+            TOO_SHORT | OVERLONG_3 | SURROGATE,
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+        };
+
+        // Indexed by the low nibble of the first byte.
+        const uint8_t byte1LowTable[16] = {
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+            CARRY | OVERLONG_2,
+            CARRY,
+            CARRY,
+            CARRY | TOO_LARGE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000
+        };
+
+        // Indexed by the high nibble of the second byte.
+        const uint8_t byte2HighTable[16] = {
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+        };
+
+        // The largest value each of the last three bytes in a block can have without starting an incomplete sequence.
+        const uint8_t incompleteTable[32] = {
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+        };
+
+        LIBSTRINGS_TARGET("sse4.2")
+        inline __m128i ShiftRightNibble128(const __m128i v) {
+            return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+        }
+
+        LIBSTRINGS_TARGET("sse4.2")
+        inline __m128i CheckBlock128(const __m128i input, const __m128i prevInput) {
+            const __m128i prev1 = _mm_alignr_epi8(input, prevInput, 16 - 1);
+            const __m128i prev2 = _mm_alignr_epi8(input, prevInput, 16 - 2);
+            const __m128i prev3 = _mm_alignr_epi8(input, prevInput, 16 - 3);
+
+            const __m128i byte1High = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)byte1HighTable), ShiftRightNibble128(prev1));
+            const __m128i byte1Low = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)byte1LowTable), _mm_and_si128(prev1, _mm_set1_epi8(0x0F)));
+            const __m128i byte2High = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)byte2HighTable), ShiftRightNibble128(input));
+            const __m128i specialCases = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+            //Only 111_____ and 1111____ survive the subtractions with their high bit set.
+            const __m128i isThirdByte = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+            const __m128i isFourthByte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+            const __m128i must23 = _mm_and_si128(_mm_or_si128(isThirdByte, isFourthByte), _mm_set1_epi8((char)0x80));
+
+            return _mm_xor_si128(must23, specialCases);
+        }
+
+        LIBSTRINGS_TARGET("sse4.2")
+        bool IsValidUTF8SSE42(const char * str, const size_t length) {
+            const __m128i maxValue = _mm_loadu_si128((const __m128i*)(incompleteTable + 16));
+            __m128i error = _mm_setzero_si128();
+            __m128i prevInput = _mm_setzero_si128();
+            __m128i prevIncomplete = _mm_setzero_si128();
+
+            size_t pos = 0;
+            for (; pos + 16 <= length; pos += 16) {
+                const __m128i input = _mm_loadu_si128((const __m128i*)(str + pos));
+                if (_mm_movemask_epi8(input) == 0) {
+                    //ASCII block: only an incomplete sequence at the end of the previous block can be an error.
+                    error = _mm_or_si128(error, prevIncomplete);
+                } else {
+                    error = _mm_or_si128(error, CheckBlock128(input, prevInput));
+                    prevIncomplete = _mm_subs_epu8(input, maxValue);
+                }
+                prevInput = input;
+            }
+
+            //Pad the tail with ASCII zeroes, which also catches sequences left incomplete.
+            if (pos < length) {
+                uint8_t tail[16] = { 0 };
+                memcpy(tail, str + pos, length - pos);
+                const __m128i input = _mm_loadu_si128((const __m128i*)tail);
+                error = _mm_or_si128(error, CheckBlock128(input, prevInput));
+                prevIncomplete = _mm_subs_epu8(input, maxValue);
+            }
+            error = _mm_or_si128(error, prevIncomplete);
+
+            return _mm_testz_si128(error, error) != 0;
+        }
+
+        LIBSTRINGS_TARGET("avx2")
+        inline __m256i ShiftRightNibble256(const __m256i v) {
+            return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+        }
+
+        LIBSTRINGS_TARGET("avx2")
+        inline __m256i LoadTable256(const uint8_t * table) {
+            return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)table));
+        }
+
+        LIBSTRINGS_TARGET("avx2")
+        inline __m256i CheckBlock256(const __m256i input, const __m256i prevInput) {
+            //Shifting across the 128-bit lanes requires bringing the high lane of the previous block alongside.
+            const __m256i straddle = _mm256_permute2x128_si256(prevInput, input, 0x21);
+            const __m256i prev1 = _mm256_alignr_epi8(input, straddle, 16 - 1);
+            const __m256i prev2 = _mm256_alignr_epi8(input, straddle, 16 - 2);
+            const __m256i prev3 = _mm256_alignr_epi8(input, straddle, 16 - 3);
+
+            const __m256i byte1High = _mm256_shuffle_epi8(LoadTable256(byte1HighTable), ShiftRightNibble256(prev1));
+            const __m256i byte1Low = _mm256_shuffle_epi8(LoadTable256(byte1LowTable), _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)));
+            const __m256i byte2High = _mm256_shuffle_epi8(LoadTable256(byte2HighTable), ShiftRightNibble256(input));
+            const __m256i specialCases = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+            const __m256i isThirdByte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+            const __m256i isFourthByte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+            const __m256i must23 = _mm256_and_si256(_mm256_or_si256(isThirdByte, isFourthByte), _mm256_set1_epi8((char)0x80));
+
+            return _mm256_xor_si256(must23, specialCases);
+        }
+
+        LIBSTRINGS_TARGET("avx2")
+        bool IsValidUTF8AVX2(const char * str, const size_t length) {
+            const __m256i maxValue = _mm256_loadu_si256((const __m256i*)incompleteTable);
+            __m256i error = _mm256_setzero_si256();
+            __m256i prevInput = _mm256_setzero_si256();
+            __m256i prevIncomplete = _mm256_setzero_si256();
+
+            size_t pos = 0;
+            for (; pos + 32 <= length; pos += 32) {
+                const __m256i input = _mm256_loadu_si256((const __m256i*)(str + pos));
+                if (_mm256_movemask_epi8(input) == 0) {
+                    error = _mm256_or_si256(error, prevIncomplete);
+                } else {
+                    error = _mm256_or_si256(error, CheckBlock256(input, prevInput));
+                    prevIncomplete = _mm256_subs_epu8(input, maxValue);
+                }
+                prevInput = input;
+            }
+
+            if (pos < length) {
+                uint8_t tail[32] = { 0 };
+                memcpy(tail, str + pos, length - pos);
+                const __m256i input = _mm256_loadu_si256((const __m256i*)tail);
+                error = _mm256_or_si256(error, CheckBlock256(input, prevInput));
+                prevIncomplete = _mm256_subs_epu8(input, maxValue);
+            }
+            error = _mm256_or_si256(error, prevIncomplete);
+
+            return _mm256_testz_si256(error, error) != 0;
+        }
+
+        bool CPUSupportsAVX2() {
+#   if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+            __cpuid(info, 1);
+            //AVX2 also needs the OS to save the YMM registers.
+            if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 0x6) != 0x6)
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#   else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#   endif
+        }
+
+        bool CPUSupportsSSE42() {
+#   if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 20)) != 0;
+#   else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.2");
+#   endif
+        }
+#endif
+
+        typedef bool (*validator)(const char *, const size_t);
+
+        validator SelectValidator() {
+#ifdef LIBSTRINGS_SIMD_UTF8
+            if (CPUSupportsAVX2())
+                return IsValidUTF8AVX2;
+            else if (CPUSupportsSSE42())
+                return IsValidUTF8SSE42;
+#endif
+            return IsValidUTF8Scalar;
+        }
+
+        const validator validate = SelectValidator();
+    }
+
+    bool IsValidUTF8(const char * str, const size_t length) {
+        return validate(str, length);
+    }
+
+    bool HasUTF8Validator(const utf8_validator validator) {
+        switch (validator) {
+        case UTF8_VALIDATOR_SCALAR:
+            return true;
+#ifdef LIBSTRINGS_SIMD_UTF8
+        case UTF8_VALIDATOR_SSE42:
+            return CPUSupportsSSE42();
+        case UTF8_VALIDATOR_AVX2:
+            return CPUSupportsAVX2();
+#endif
+        default:
+            return false;
+        }
+    }
+
+    bool IsValidUTF8With(const utf8_validator validator, const char * str, const size_t length) {
+#ifdef LIBSTRINGS_SIMD_UTF8
+        if (validator == UTF8_VALIDATOR_AVX2)
+            return IsValidUTF8AVX2(str, length);
+        else if (validator == UTF8_VALIDATOR_SSE42)
+            return IsValidUTF8SSE42(str, length);
+#endif
+        return IsValidUTF8Scalar(str, length);
+    }
+}